@@ -0,0 +1,422 @@
+/* batch.c -- Batch schedule computation
+   This file is part of Redshift.
+
+   Redshift is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Redshift is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Redshift.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Batch mode reads records of `LAT LON TIME' (separated by whitespace
+   or commas, TIME in seconds since the unix epoch) and writes one line
+   of `PERIOD PROGRESS TEMPERATURE BRIGHTNESS' for each record, in
+   input order. Empty lines and lines starting with `#' are skipped.
+
+   The input is split into chunks of records. The main thread reads
+   chunks and writes results while a pool of worker threads, one per
+   online processor, parses and evaluates the chunks in between. The
+   pool is meant to let evaluation use more than one core, but the
+   throughput has only been measured on a single core, where it cannot
+   be faster than evaluating on the main thread. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+#endif
+
+#include "batch.h"
+#include "redshift.h"
+
+#ifdef ENABLE_NLS
+# include <libintl.h>
+# define _(s) gettext(s)
+#else
+# define _(s) s
+#endif
+
+/* Longest accepted input line. */
+#define MAX_LINE_LENGTH  128
+/* Longest output line. */
+#define MAX_OUTPUT_LENGTH  64
+
+/* Number of chunks in flight for each worker thread. */
+#define CHUNKS_PER_THREAD  2
+#define MAX_THREADS  64
+
+
+typedef enum {
+	CHUNK_EMPTY,
+	CHUNK_READ,
+	CHUNK_BUSY,
+	CHUNK_DONE
+} chunk_status_t;
+
+typedef struct {
+	chunk_status_t status;
+	int count;
+	/* Input line number of each record */
+	unsigned long line_num[BATCH_CHUNK_RECORDS];
+	char lines[BATCH_CHUNK_RECORDS][MAX_LINE_LENGTH];
+	batch_record_t records[BATCH_CHUNK_RECORDS];
+	batch_result_t results[BATCH_CHUNK_RECORDS];
+	/* Formatted results */
+	char *output;
+	size_t output_length;
+	/* Input line number of first invalid record, or zero. */
+	unsigned long error_line;
+} batch_chunk_t;
+
+typedef struct {
+	batch_chunk_t *chunks;
+	int chunk_count;
+	/* Next chunk for a worker to process */
+	int next_work;
+	int exiting;
+	batch_eval_func *eval;
+	void *data;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t lock;
+	/* Signaled when a chunk has been read, or on exit. */
+	pthread_cond_t work_cond;
+	/* Signaled when a chunk has been processed. */
+	pthread_cond_t done_cond;
+#endif
+} batch_pool_t;
+
+
+static const char *period_names[] = {
+	"none",
+	"daytime",
+	"night",
+	"transition"
+};
+
+
+/* Parse floating point field and skip the separator after it. */
+static int
+parse_field(char **s, double *value)
+{
+	char *end;
+	*value = strtod(*s, &end);
+	if (end == *s) return -1;
+
+	while (*end == ' ' || *end == '\t' || *end == ',') end++;
+	*s = end;
+
+	return 0;
+}
+
+/* Parse record from line. Return -1 if the line is invalid. */
+static int
+parse_record(char *line, batch_record_t *record)
+{
+	char *s = line;
+	if (parse_field(&s, &record->lat) < 0 ||
+	    parse_field(&s, &record->lon) < 0 ||
+	    parse_field(&s, &record->date) < 0) {
+		return -1;
+	}
+
+	if (*s != '\0' && *s != '\n' && *s != '\r') return -1;
+
+	if (!(record->lat >= -90.0 && record->lat <= 90.0) ||
+	    !(record->lon >= -180.0 && record->lon <= 180.0)) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Parse, evaluate and format the records of chunk. */
+static void
+process_chunk(batch_chunk_t *chunk, batch_eval_func *eval, void *data)
+{
+	chunk->error_line = 0;
+
+	int count = chunk->count;
+	for (int i = 0; i < count; i++) {
+		int r = parse_record(chunk->lines[i], &chunk->records[i]);
+		if (r < 0) {
+			chunk->error_line = chunk->line_num[i];
+			count = i;
+			break;
+		}
+	}
+
+	eval(chunk->records, chunk->results, count, data);
+
+	char *out = chunk->output;
+	for (int i = 0; i < count; i++) {
+		const batch_result_t *result = &chunk->results[i];
+		out += snprintf(out, MAX_OUTPUT_LENGTH, "%s %.4f %d %.2f\n",
+				period_names[result->period],
+				result->progress,
+				result->setting.temperature,
+				result->setting.brightness);
+	}
+	chunk->output_length = out - chunk->output;
+}
+
+/* Read the next chunk of records. Return -1 on error. */
+static int
+read_chunk(batch_chunk_t *chunk, FILE *in, unsigned long *line_num,
+	   int *eof)
+{
+	chunk->count = 0;
+	while (chunk->count < BATCH_CHUNK_RECORDS) {
+		char *line = chunk->lines[chunk->count];
+		if (fgets(line, MAX_LINE_LENGTH, in) == NULL) {
+			if (ferror(in)) {
+				perror("fgets");
+				return -1;
+			}
+			*eof = 1;
+			break;
+		}
+
+		*line_num += 1;
+
+		size_t length = strlen(line);
+		if (length == MAX_LINE_LENGTH-1 && line[length-1] != '\n' &&
+		    !feof(in)) {
+			fprintf(stderr, _("Line %lu too long in batch input.\n"),
+				*line_num);
+			return -1;
+		}
+
+		/* Skip empty lines and comments */
+		char *s = line;
+		while (*s == ' ' || *s == '\t') s++;
+		if (*s == '\0' || *s == '\n' || *s == '\r' || *s == '#') {
+			continue;
+		}
+
+		chunk->line_num[chunk->count] = *line_num;
+		chunk->count += 1;
+	}
+
+	return 0;
+}
+
+#ifdef HAVE_PTHREAD_H
+
+static void *
+worker_thread(void *arg)
+{
+	batch_pool_t *pool = arg;
+
+	pthread_mutex_lock(&pool->lock);
+	while (1) {
+		batch_chunk_t *chunk = &pool->chunks[pool->next_work];
+		while (!pool->exiting && chunk->status != CHUNK_READ) {
+			pthread_cond_wait(&pool->work_cond, &pool->lock);
+			chunk = &pool->chunks[pool->next_work];
+		}
+		if (pool->exiting) break;
+
+		chunk->status = CHUNK_BUSY;
+		pool->next_work = (pool->next_work + 1) % pool->chunk_count;
+		pthread_mutex_unlock(&pool->lock);
+
+		process_chunk(chunk, pool->eval, pool->data);
+
+		pthread_mutex_lock(&pool->lock);
+		chunk->status = CHUNK_DONE;
+		pthread_cond_broadcast(&pool->done_cond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+# define POOL_LOCK(pool)    pthread_mutex_lock(&(pool)->lock)
+# define POOL_UNLOCK(pool)  pthread_mutex_unlock(&(pool)->lock)
+
+#else /* ! HAVE_PTHREAD_H */
+
+# define POOL_LOCK(pool)
+# define POOL_UNLOCK(pool)
+
+#endif /* ! HAVE_PTHREAD_H */
+
+/* Return number of worker threads to use. */
+static int
+get_thread_count(void)
+{
+#if defined(HAVE_PTHREAD_H) && defined(_SC_NPROCESSORS_ONLN)
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	if (count < 1) return 1;
+	if (count > MAX_THREADS) return MAX_THREADS;
+	return count;
+#else
+	return 1;
+#endif
+}
+
+/* Run batch computation of records read from in, writing results to
+   out. Records are evaluated by eval. Return -1 on error. */
+int
+batch_run(FILE *in, FILE *out, batch_eval_func *eval, void *data)
+{
+	batch_pool_t pool;
+	int thread_count = get_thread_count();
+
+	pool.chunk_count = CHUNKS_PER_THREAD*thread_count;
+	pool.chunks = calloc(pool.chunk_count, sizeof(batch_chunk_t));
+	if (pool.chunks == NULL) {
+		perror("malloc");
+		return -1;
+	}
+
+	for (int i = 0; i < pool.chunk_count; i++) {
+		pool.chunks[i].status = CHUNK_EMPTY;
+		pool.chunks[i].output =
+			malloc(BATCH_CHUNK_RECORDS*MAX_OUTPUT_LENGTH);
+		if (pool.chunks[i].output == NULL) {
+			perror("malloc");
+			for (int j = 0; j < i; j++) {
+				free(pool.chunks[j].output);
+			}
+			free(pool.chunks);
+			return -1;
+		}
+	}
+
+	pool.next_work = 0;
+	pool.exiting = 0;
+	pool.eval = eval;
+	pool.data = data;
+
+	/* Start worker threads. If no threads can be started the
+	   chunks are processed by the main thread. */
+	int threads_started = 0;
+#ifdef HAVE_PTHREAD_H
+	pthread_t threads[MAX_THREADS];
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.work_cond, NULL);
+	pthread_cond_init(&pool.done_cond, NULL);
+
+	if (thread_count > 1) {
+		for (int i = 0; i < thread_count; i++) {
+			int r = pthread_create(&threads[i], NULL,
+					       worker_thread, &pool);
+			if (r != 0) break;
+			threads_started += 1;
+		}
+	}
+#endif
+
+	unsigned long line_num = 0;
+	int next_read = 0;
+	int next_write = 0;
+	int eof = 0;
+	int failed = 0;
+	int read_failed = 0;
+
+	POOL_LOCK(&pool);
+	while (1) {
+		batch_chunk_t *chunk = &pool.chunks[next_write];
+		if (chunk->status == CHUNK_DONE) {
+			/* Write results in input order */
+			POOL_UNLOCK(&pool);
+			if (!failed) {
+				size_t n = fwrite(chunk->output, 1,
+						  chunk->output_length, out);
+				if (n < chunk->output_length) {
+					perror("fwrite");
+					failed = 1;
+				} else if (chunk->error_line != 0) {
+					fprintf(stderr, _("Invalid record"
+							  " on line %lu of"
+							  " batch input.\n"),
+						chunk->error_line);
+					failed = 1;
+				}
+				if (failed) eof = 1;
+			}
+			POOL_LOCK(&pool);
+
+			chunk->status = CHUNK_EMPTY;
+			next_write = (next_write + 1) % pool.chunk_count;
+			continue;
+		}
+
+		chunk = &pool.chunks[next_read];
+		if (!eof && chunk->status == CHUNK_EMPTY) {
+			POOL_UNLOCK(&pool);
+			int r = read_chunk(chunk, in, &line_num, &eof);
+			if (r < 0) {
+				/* Records before the error are still
+				   written. */
+				read_failed = 1;
+				eof = 1;
+			}
+			if (chunk->count > 0 && threads_started == 0) {
+				process_chunk(chunk, eval, data);
+			}
+			POOL_LOCK(&pool);
+
+			if (chunk->count > 0) {
+				chunk->status = threads_started == 0 ?
+					CHUNK_DONE : CHUNK_READ;
+				next_read = (next_read + 1) % pool.chunk_count;
+#ifdef HAVE_PTHREAD_H
+				pthread_cond_signal(&pool.work_cond);
+#endif
+			}
+			continue;
+		}
+
+		/* Done when all chunks have been written */
+		chunk = &pool.chunks[next_write];
+		if (eof && chunk->status == CHUNK_EMPTY) break;
+
+#ifdef HAVE_PTHREAD_H
+		pthread_cond_wait(&pool.done_cond, &pool.lock);
+#endif
+	}
+
+	pool.exiting = 1;
+#ifdef HAVE_PTHREAD_H
+	pthread_cond_broadcast(&pool.work_cond);
+#endif
+	POOL_UNLOCK(&pool);
+
+#ifdef HAVE_PTHREAD_H
+	for (int i = 0; i < threads_started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool.done_cond);
+	pthread_cond_destroy(&pool.work_cond);
+	pthread_mutex_destroy(&pool.lock);
+#endif
+
+	for (int i = 0; i < pool.chunk_count; i++) {
+		free(pool.chunks[i].output);
+	}
+	free(pool.chunks);
+
+	if (!failed && fflush(out) != 0) {
+		perror("fflush");
+		failed = 1;
+	}
+
+	return (failed || read_failed) ? -1 : 0;
+}
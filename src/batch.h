@@ -0,0 +1,49 @@
+/* batch.h -- Batch schedule computation header
+   This file is part of Redshift.
+
+   Redshift is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Redshift is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Redshift.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef REDSHIFT_BATCH_H
+#define REDSHIFT_BATCH_H
+
+#include <stdio.h>
+
+#include "redshift.h"
+
+/* Maximum number of records passed to the evaluation function. */
+#define BATCH_CHUNK_RECORDS  1024
+
+typedef struct {
+	double lat;
+	double lon;
+	/* Seconds since unix epoch */
+	double date;
+} batch_record_t;
+
+typedef struct {
+	period_t period;
+	double progress;
+	color_setting_t setting;
+} batch_result_t;
+
+/* Evaluate records into results. Called concurrently from worker
+   threads, so it must not modify shared state. */
+typedef void batch_eval_func(
+	const batch_record_t *records, batch_result_t *results, int count,
+	void *data);
+
+int batch_run(FILE *in, FILE *out, batch_eval_func *eval, void *data);
+
+#endif /* ! REDSHIFT_BATCH_H */
@@ -0,0 +1,558 @@
+/* colorramp-cache.c -- Cache of generated gamma ramps source
+   This file is part of Redshift.
+
+   Redshift is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Redshift is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Redshift.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Fades and toggling between day and night settings generate the same
+   gamma ramps over and over. This cache keeps the most recently used
+   ramps so that repeated settings only cost a copy. Settings are
+   quantized before the ramps are generated, so a cached ramp is always
+   identical to the one that would be generated for its key. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "colorramp-cache.h"
+#include "colorramp.h"
+#include "redshift.h"
+
+/* Upper bound on the memory used by cached ramps (in bytes). */
+#define CACHE_MAX_BYTES    (4*1024*1024)
+/* Upper bound on the number of cached ramps. */
+#define CACHE_MAX_ENTRIES  1024
+/* Number of hash buckets. Must be a power of two. */
+#define CACHE_BUCKETS      256
+
+/* Number of recently used ramp sizes and sources to plan for. */
+#define PLAN_MAX_PROFILES  8
+/* Upper bound on the memory used by a fade plan (in bytes). */
+#define PLAN_MAX_BYTES     (8*1024*1024)
+
+/* With DEBUG_ALLOC, heap allocations are counted so that tests can
+   check that the update path does not allocate once the cache is
+   warm. */
+#ifdef DEBUG_ALLOC
+static unsigned long alloc_count = 0;
+# define COUNT_ALLOC()  (alloc_count += 1)
+#else
+# define COUNT_ALLOC()  ((void)0)
+#endif
+
+
+typedef struct cache_entry cache_entry_t;
+
+struct cache_entry {
+	colorramp_key_t key;
+	uint32_t hash;
+	/* Next entry in hash bucket. */
+	cache_entry_t *next;
+	/* Neighbours in LRU list. Most recently used is first. */
+	cache_entry_t *lru_prev;
+	cache_entry_t *lru_next;
+	/* Red, green and blue ramps of key.ramp_size each. */
+	uint16_t ramps[];
+};
+
+static cache_entry_t *buckets[CACHE_BUCKETS];
+static cache_entry_t *lru_first = NULL;
+static cache_entry_t *lru_last = NULL;
+static size_t cache_bytes = 0;
+static int cache_entries = 0;
+static colorramp_cache_stats_t cache_stats = { 0, 0, 0 };
+
+/* Ramp size and source of a recent fill. Fade plans are generated
+   for each of these. */
+typedef struct {
+	int ramp_size;
+	const uint16_t *source;
+} plan_profile_t;
+
+static plan_profile_t recent_profiles[PLAN_MAX_PROFILES];
+static int recent_count = 0;
+
+/* Fade plan. Ramps of frame f for profile p start at
+   plan_ramps[plan_offset[p] + 3*f*plan_profiles[p].ramp_size]. */
+static plan_profile_t plan_profiles[PLAN_MAX_PROFILES];
+static size_t plan_offset[PLAN_MAX_PROFILES];
+static int plan_profile_count = 0;
+static colorramp_key_t *plan_keys = NULL;
+static int plan_count = 0;
+static int plan_keys_size = 0;
+static uint16_t *plan_ramps = NULL;
+static size_t plan_ramps_size = 0;
+/* Frame that is expected to be requested next. */
+static int plan_cursor = 0;
+
+
+static int
+quantize(float value)
+{
+	return lroundf(value * COLORRAMP_CACHE_QUANTUM);
+}
+
+/* Create cache key for ramps of ramp_size generated from setting. */
+void
+colorramp_cache_key(
+	colorramp_key_t *key, int ramp_size,
+	const color_setting_t *setting, const uint16_t *source)
+{
+	key->ramp_size = ramp_size;
+	key->temperature = setting->temperature;
+	key->brightness = quantize(setting->brightness);
+	for (int i = 0; i < 3; i++) {
+		key->gamma[i] = quantize(setting->gamma[i]);
+	}
+	key->source = source;
+}
+
+/* FNV-1a hash of key. */
+static uint32_t
+key_hash(const colorramp_key_t *key)
+{
+	uint32_t values[] = {
+		key->ramp_size, key->temperature, key->brightness,
+		key->gamma[0], key->gamma[1], key->gamma[2],
+		(uint32_t)(uintptr_t)key->source
+	};
+
+	uint32_t hash = 2166136261u;
+	for (int i = 0; i < sizeof(values)/sizeof(values[0]); i++) {
+		for (int j = 0; j < 4; j++) {
+			hash ^= (values[i] >> (8*j)) & 0xff;
+			hash *= 16777619u;
+		}
+	}
+
+	return hash;
+}
+
+int
+colorramp_cache_key_equal(const colorramp_key_t *a, const colorramp_key_t *b)
+{
+	return a->ramp_size == b->ramp_size &&
+		a->temperature == b->temperature &&
+		a->brightness == b->brightness &&
+		a->gamma[0] == b->gamma[0] &&
+		a->gamma[1] == b->gamma[1] &&
+		a->gamma[2] == b->gamma[2] &&
+		a->source == b->source;
+}
+
+/* Return 1 if keys are for the same setting, ignoring size and source. */
+static int
+key_setting_equal(const colorramp_key_t *a, const colorramp_key_t *b)
+{
+	return a->temperature == b->temperature &&
+		a->brightness == b->brightness &&
+		a->gamma[0] == b->gamma[0] &&
+		a->gamma[1] == b->gamma[1] &&
+		a->gamma[2] == b->gamma[2];
+}
+
+static size_t
+entry_bytes(int ramp_size)
+{
+	return sizeof(cache_entry_t) + 3*ramp_size*sizeof(uint16_t);
+}
+
+static void
+lru_unlink(cache_entry_t *entry)
+{
+	if (entry->lru_prev != NULL) {
+		entry->lru_prev->lru_next = entry->lru_next;
+	} else {
+		lru_first = entry->lru_next;
+	}
+
+	if (entry->lru_next != NULL) {
+		entry->lru_next->lru_prev = entry->lru_prev;
+	} else {
+		lru_last = entry->lru_prev;
+	}
+}
+
+static void
+lru_push_first(cache_entry_t *entry)
+{
+	entry->lru_prev = NULL;
+	entry->lru_next = lru_first;
+	if (lru_first != NULL) {
+		lru_first->lru_prev = entry;
+	} else {
+		lru_last = entry;
+	}
+	lru_first = entry;
+}
+
+/* Remove entry from the cache without freeing it. */
+static void
+entry_unlink(cache_entry_t *entry)
+{
+	cache_entry_t **p = &buckets[entry->hash & (CACHE_BUCKETS-1)];
+	while (*p != entry) p = &(*p)->next;
+	*p = entry->next;
+
+	lru_unlink(entry);
+
+	cache_bytes -= entry_bytes(entry->key.ramp_size);
+	cache_entries -= 1;
+}
+
+/* Remove entry from the cache and free it. */
+static void
+entry_remove(cache_entry_t *entry)
+{
+	entry_unlink(entry);
+	free(entry);
+}
+
+/* Generate the ramps for key into the red, green and blue ramps. */
+static void
+generate_ramps(
+	uint16_t *gamma_r, uint16_t *gamma_g, uint16_t *gamma_b,
+	const colorramp_key_t *key)
+{
+	color_setting_t setting;
+	setting.temperature = key->temperature;
+	setting.brightness = key->brightness /
+		(float)COLORRAMP_CACHE_QUANTUM;
+	for (int i = 0; i < 3; i++) {
+		setting.gamma[i] = key->gamma[i] /
+			(float)COLORRAMP_CACHE_QUANTUM;
+	}
+
+	int size = key->ramp_size;
+	if (key->source != NULL) {
+		memcpy(gamma_r, &key->source[0*size], size*sizeof(uint16_t));
+		memcpy(gamma_g, &key->source[1*size], size*sizeof(uint16_t));
+		memcpy(gamma_b, &key->source[2*size], size*sizeof(uint16_t));
+		colorramp_fill(gamma_r, gamma_g, gamma_b, size, &setting);
+	} else {
+		colorramp_fill_pure(gamma_r, gamma_g, gamma_b, size,
+				    &setting);
+	}
+}
+
+/* Check whether the ramps for setting are the ones last applied to an
+   output. Return 1 if they are, so that the update can be skipped.
+   Otherwise record them as applied and return 0. Callers reset
+   applied->ramp_size to zero when the output no longer shows the
+   recorded ramps, e.g. after a failed update or a restore. */
+int
+colorramp_cache_applied(
+	colorramp_key_t *applied, int ramp_size,
+	const color_setting_t *setting, const uint16_t *source)
+{
+	colorramp_key_t key;
+	colorramp_cache_key(&key, ramp_size, setting, source);
+
+	if (colorramp_cache_key_equal(applied, &key)) {
+		cache_stats.elided += 1;
+		return 1;
+	}
+
+	*applied = key;
+	return 0;
+}
+
+/* Move ramp size and source to the front of the recent profiles. */
+static void
+touch_profile(int ramp_size, const uint16_t *source)
+{
+	int i;
+	for (i = 0; i < recent_count; i++) {
+		if (recent_profiles[i].ramp_size == ramp_size &&
+		    recent_profiles[i].source == source) break;
+	}
+
+	if (i == 0 && recent_count > 0) return;
+	if (i == recent_count) {
+		if (recent_count < PLAN_MAX_PROFILES) recent_count += 1;
+		i = recent_count - 1;
+	}
+
+	memmove(&recent_profiles[1], &recent_profiles[0],
+		i*sizeof(plan_profile_t));
+	recent_profiles[0].ramp_size = ramp_size;
+	recent_profiles[0].source = source;
+}
+
+/* Look up key in the fade plan. Return pointer to the red, green and
+   blue ramps or NULL if the frame was not planned. */
+static const uint16_t *
+plan_lookup(const colorramp_key_t *key)
+{
+	int p;
+	for (p = 0; p < plan_profile_count; p++) {
+		if (plan_profiles[p].ramp_size == key->ramp_size &&
+		    plan_profiles[p].source == key->source) break;
+	}
+	if (p == plan_profile_count) return NULL;
+
+	/* Frames are usually requested in order, so start searching
+	   at the cursor. */
+	for (int i = 0; i < plan_count; i++) {
+		int f = (plan_cursor + i) % plan_count;
+		if (key_setting_equal(&plan_keys[f], key)) {
+			plan_cursor = f;
+			return &plan_ramps[plan_offset[p] +
+					   3*f*key->ramp_size];
+		}
+	}
+
+	return NULL;
+}
+
+/* Generate ramps for the given fade frames up front, for each ramp size
+   and source that was recently filled. Subsequent fills for the frames
+   only copy the planned ramps. Planning again replaces the previous
+   plan and reuses its buffers; a count of zero drops the plan. */
+int
+colorramp_cache_plan(const color_setting_t *frames, int count)
+{
+	plan_count = 0;
+	plan_cursor = 0;
+	plan_profile_count = 0;
+	if (count <= 0) return 0;
+
+	if (count > plan_keys_size) {
+		COUNT_ALLOC();
+		colorramp_key_t *keys = realloc(plan_keys,
+						count*sizeof(colorramp_key_t));
+		if (keys == NULL) {
+			perror("realloc");
+			return -1;
+		}
+		plan_keys = keys;
+		plan_keys_size = count;
+	}
+
+	/* Quantize frames and skip repeated settings. */
+	for (int i = 0; i < count; i++) {
+		colorramp_key_t *key = &plan_keys[plan_count];
+		colorramp_cache_key(key, 0, &frames[i], NULL);
+		if (plan_count > 0 &&
+		    key_setting_equal(&plan_keys[plan_count-1], key)) {
+			continue;
+		}
+		plan_count += 1;
+	}
+
+	/* Lay out profiles in one buffer while they fit. */
+	size_t bytes = 0;
+	for (int p = 0; p < recent_count; p++) {
+		size_t profile_bytes = 3*(size_t)plan_count*
+			recent_profiles[p].ramp_size*sizeof(uint16_t);
+		if (bytes + profile_bytes > PLAN_MAX_BYTES) break;
+
+		plan_profiles[p] = recent_profiles[p];
+		plan_offset[p] = bytes/sizeof(uint16_t);
+		plan_profile_count += 1;
+		bytes += profile_bytes;
+	}
+
+	if (bytes > plan_ramps_size) {
+		COUNT_ALLOC();
+		uint16_t *ramps = realloc(plan_ramps, bytes);
+		if (ramps == NULL) {
+			perror("realloc");
+			plan_count = 0;
+			plan_profile_count = 0;
+			return -1;
+		}
+		plan_ramps = ramps;
+		plan_ramps_size = bytes;
+	}
+
+	for (int p = 0; p < plan_profile_count; p++) {
+		int size = plan_profiles[p].ramp_size;
+		for (int f = 0; f < plan_count; f++) {
+			colorramp_key_t key = plan_keys[f];
+			key.ramp_size = size;
+			key.source = plan_profiles[p].source;
+
+			uint16_t *ramps =
+				&plan_ramps[plan_offset[p] + 3*f*size];
+			generate_ramps(&ramps[0*size], &ramps[1*size],
+				       &ramps[2*size], &key);
+		}
+	}
+
+	return 0;
+}
+
+/* Fill gamma ramps of the given size for setting. If source is not NULL
+   it points to the saved red, green and blue ramps (of size each) that
+   the adjustment is applied on top of. Otherwise the ramps are
+   generated from the pure state. */
+void
+colorramp_cache_fill(
+	uint16_t *gamma_r, uint16_t *gamma_g, uint16_t *gamma_b,
+	int size, const color_setting_t *setting, const uint16_t *source)
+{
+	colorramp_key_t key;
+	colorramp_cache_key(&key, size, setting, source);
+
+	touch_profile(size, source);
+
+	const uint16_t *planned = plan_lookup(&key);
+	if (planned != NULL) {
+		cache_stats.hits += 1;
+		memcpy(gamma_r, &planned[0*size], size*sizeof(uint16_t));
+		memcpy(gamma_g, &planned[1*size], size*sizeof(uint16_t));
+		memcpy(gamma_b, &planned[2*size], size*sizeof(uint16_t));
+		return;
+	}
+
+	uint32_t hash = key_hash(&key);
+	cache_entry_t **bucket = &buckets[hash & (CACHE_BUCKETS-1)];
+
+	cache_entry_t *entry = *bucket;
+	while (entry != NULL) {
+		if (entry->hash == hash &&
+		    colorramp_cache_key_equal(&entry->key, &key)) {
+			break;
+		}
+		entry = entry->next;
+	}
+
+	if (entry != NULL) {
+		cache_stats.hits += 1;
+
+		/* Mark as most recently used */
+		lru_unlink(entry);
+		lru_push_first(entry);
+	} else {
+		cache_stats.misses += 1;
+
+		size_t bytes = entry_bytes(size);
+		if (bytes > CACHE_MAX_BYTES) {
+			generate_ramps(gamma_r, gamma_g, gamma_b, &key);
+			return;
+		}
+
+		/* When the cache is full, reuse the least recently used
+		   entry of the same size, so that a full cache does not
+		   need to allocate even if outputs have different ramp
+		   sizes. Otherwise evict least recently used entries to
+		   make room. */
+		int full = cache_bytes + bytes > CACHE_MAX_BYTES ||
+			cache_entries >= CACHE_MAX_ENTRIES;
+		if (full) {
+			entry = lru_last;
+			while (entry != NULL && entry->key.ramp_size != size) {
+				entry = entry->lru_prev;
+			}
+			if (entry != NULL) entry_unlink(entry);
+		}
+
+		while (entry == NULL && lru_last != NULL &&
+		       (cache_bytes + bytes > CACHE_MAX_BYTES ||
+			cache_entries >= CACHE_MAX_ENTRIES)) {
+			entry_remove(lru_last);
+		}
+
+		if (entry == NULL) {
+			COUNT_ALLOC();
+			entry = malloc(bytes);
+		}
+		if (entry == NULL) {
+			/* The cache is only an optimization. */
+			generate_ramps(gamma_r, gamma_g, gamma_b, &key);
+			return;
+		}
+
+		entry->key = key;
+		entry->hash = hash;
+		generate_ramps(&entry->ramps[0*size], &entry->ramps[1*size],
+			       &entry->ramps[2*size], &key);
+
+		entry->next = *bucket;
+		*bucket = entry;
+		lru_push_first(entry);
+
+		cache_bytes += bytes;
+		cache_entries += 1;
+	}
+
+	memcpy(gamma_r, &entry->ramps[0*size], size*sizeof(uint16_t));
+	memcpy(gamma_g, &entry->ramps[1*size], size*sizeof(uint16_t));
+	memcpy(gamma_b, &entry->ramps[2*size], size*sizeof(uint16_t));
+}
+
+/* Remove all ramps generated from source. Must be called before saved
+   ramps that have been used as source are changed or freed. */
+void
+colorramp_cache_invalidate(const uint16_t *source)
+{
+	cache_entry_t *entry = lru_first;
+	while (entry != NULL) {
+		cache_entry_t *next = entry->lru_next;
+		if (entry->key.source == source) entry_remove(entry);
+		entry = next;
+	}
+
+	for (int i = 0; i < recent_count; i++) {
+		if (recent_profiles[i].source != source) continue;
+		memmove(&recent_profiles[i], &recent_profiles[i+1],
+			(recent_count-i-1)*sizeof(plan_profile_t));
+		recent_count -= 1;
+		i -= 1;
+	}
+
+	for (int p = 0; p < plan_profile_count; p++) {
+		if (plan_profiles[p].source == source) {
+			/* Drop the whole plan. */
+			plan_count = 0;
+			plan_profile_count = 0;
+			break;
+		}
+	}
+}
+
+void
+colorramp_cache_get_stats(colorramp_cache_stats_t *stats)
+{
+	*stats = cache_stats;
+}
+
+#ifdef DEBUG_ALLOC
+/* Return number of heap allocations made by the cache. */
+unsigned long
+colorramp_cache_get_alloc_count(void)
+{
+	return alloc_count;
+}
+#endif
+
+/* Free all cached ramps and the fade plan. */
+void
+colorramp_cache_free(void)
+{
+	while (lru_first != NULL) entry_remove(lru_first);
+
+	free(plan_keys);
+	free(plan_ramps);
+	plan_keys = NULL;
+	plan_ramps = NULL;
+	plan_keys_size = 0;
+	plan_ramps_size = 0;
+	plan_count = 0;
+	plan_profile_count = 0;
+	recent_count = 0;
+}
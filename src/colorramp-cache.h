@@ -0,0 +1,67 @@
+/* colorramp-cache.h -- Cache of generated gamma ramps header
+   This file is part of Redshift.
+
+   Redshift is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Redshift is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Redshift.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef REDSHIFT_COLORRAMP_CACHE_H
+#define REDSHIFT_COLORRAMP_CACHE_H
+
+#include <stdint.h>
+
+#include "redshift.h"
+
+/* Brightness and gamma are quantized to multiples of 1/QUANTUM. */
+#define COLORRAMP_CACHE_QUANTUM  10000
+
+/* Key of a generated set of gamma ramps. */
+typedef struct {
+	int ramp_size;
+	int temperature;
+	int brightness;
+	int gamma[3];
+	/* Saved ramps the adjustment is applied on top of,
+	   or NULL for the pure state. */
+	const uint16_t *source;
+} colorramp_key_t;
+
+/* Cache statistics */
+typedef struct {
+	unsigned long hits;
+	unsigned long misses;
+	/* Updates skipped because the ramps were already applied */
+	unsigned long elided;
+} colorramp_cache_stats_t;
+
+
+void colorramp_cache_key(
+	colorramp_key_t *key, int ramp_size,
+	const color_setting_t *setting, const uint16_t *source);
+int colorramp_cache_key_equal(
+	const colorramp_key_t *a, const colorramp_key_t *b);
+int colorramp_cache_applied(
+	colorramp_key_t *applied, int ramp_size,
+	const color_setting_t *setting, const uint16_t *source);
+void colorramp_cache_fill(
+	uint16_t *gamma_r, uint16_t *gamma_g, uint16_t *gamma_b,
+	int size, const color_setting_t *setting, const uint16_t *source);
+int colorramp_cache_plan(const color_setting_t *frames, int count);
+void colorramp_cache_invalidate(const uint16_t *source);
+void colorramp_cache_get_stats(colorramp_cache_stats_t *stats);
+#ifdef DEBUG_ALLOC
+unsigned long colorramp_cache_get_alloc_count(void);
+#endif
+void colorramp_cache_free(void);
+
+#endif /* ! REDSHIFT_COLORRAMP_CACHE_H */
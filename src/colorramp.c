@@ -18,10 +18,20 @@
    Copyright (c) 2013  Ingo Thies <ithies@astro.uni-bonn.de>
 */
 
+#include <stdlib.h>
 #include <stdint.h>
+#include <float.h>
 #include <math.h>
 
+/* Vector kernels are built for x86 with GCC-compatible compilers and
+   selected at runtime based on the instruction sets of the processor. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define COLORRAMP_X86_SIMD  1
+# include <immintrin.h>
+#endif
+
 #include "redshift.h"
+#include "colorramp.h"
 
 /* Whitepoint values for temperatures at 100K intervals.
    These will be interpolated for the actual temperature.
@@ -273,6 +283,26 @@ static const float blackbody_color[] = {
 };
 
 
+/* Number of base curves kept in the curve cache. */
+#define CURVE_CACHE_SIZE  8
+
+
+/* Base curve of the pure (identity) ramp.
+   Holds pow(Y, 1/gamma) for the pure ramp value Y at each index of a
+   ramp of the given size. Pure ramps for both integer and floating point
+   output are cached since the two differ in how Y is quantized. */
+typedef struct {
+	int size;
+	float gamma;
+	int is_float;
+	unsigned long last_used;
+	double *curve;
+} curve_cache_entry_t;
+
+static curve_cache_entry_t curve_cache[CURVE_CACHE_SIZE];
+static unsigned long curve_cache_clock = 0;
+
+
 static void
 interpolate_color(float a, const float *c1, const float *c2, float *c)
 {
@@ -281,6 +311,464 @@ interpolate_color(float a, const float *c1, const float *c2, float *c)
 	c[2] = (1.0-a)*c1[2] + a*c2[2];
 }
 
+/* Approximate white point of the color temperature in setting. */
+void
+colorramp_get_white_point(const color_setting_t *setting, float *white_point)
+{
+	float alpha = (setting->temperature % 100) / 100.0;
+	int temp_index = ((setting->temperature - 1000) / 100)*3;
+	interpolate_color(alpha, &blackbody_color[temp_index],
+			  &blackbody_color[temp_index+3], white_point);
+}
+
+/* Value at index i of the pure ramp of the given size. */
+static double
+pure_ramp_value(int i, int size, int is_float)
+{
+	if (is_float) return (float)((double)i/size);
+
+	uint16_t value = (double)i/size * (UINT16_MAX+1);
+	return (double)value/(UINT16_MAX+1);
+}
+
+/* Return base curve of the pure ramp for size and gamma. The curve is
+   only computed if it is not already in the cache. Returns NULL if
+   memory for the curve could not be allocated. */
+static const double *
+get_pure_curve(int size, float gamma, int is_float)
+{
+	curve_cache_entry_t *lru = &curve_cache[0];
+
+	curve_cache_clock += 1;
+	for (int i = 0; i < CURVE_CACHE_SIZE; i++) {
+		curve_cache_entry_t *entry = &curve_cache[i];
+		if (entry->curve != NULL && entry->size == size &&
+		    entry->gamma == gamma && entry->is_float == is_float) {
+			entry->last_used = curve_cache_clock;
+			return entry->curve;
+		}
+
+		if (entry->last_used < lru->last_used) lru = entry;
+	}
+
+	/* Replace the least recently used entry */
+	if (lru->curve == NULL || lru->size != size) {
+		double *curve = malloc(size*sizeof(double));
+		if (curve == NULL) return NULL;
+
+		free(lru->curve);
+		lru->curve = curve;
+	}
+
+	lru->size = size;
+	lru->gamma = gamma;
+	lru->is_float = is_float;
+	lru->last_used = curve_cache_clock;
+
+	for (int i = 0; i < size; i++) {
+		lru->curve[i] = pow(pure_ramp_value(i, size, is_float),
+				    1.0/gamma);
+	}
+
+	return lru->curve;
+}
+
+/* Vectorized ramp kernels.
+   The kernels compute pow(Y*scale, exponent) for a prefix of a single
+   channel ramp in place and return the number of values processed. The
+   power function is evaluated in single precision as
+   exp2(exponent*log2(x)). The polynomials below have a truncation error
+   well below single precision rounding for the whole input range, so
+   the integer ramps differ from the double precision path by at most one
+   in the last place (caused by truncation when the exact value is
+   very close to an integer). */
+
+#ifdef COLORRAMP_X86_SIMD
+
+/* Coefficients of log2(m) = t*(L1 + L3*t^2 + ...) with
+   t = (m-1)/(m+1), i.e. the series of 2*atanh(t)/ln(2). */
+#define L1  2.8853900817779268f
+#define L3  0.9617966939259756f
+#define L5  0.5770780163555854f
+#define L7  0.4121985831111324f
+#define L9  0.3205988979753252f
+
+/* Coefficients of exp2(f) = sum (f*ln(2))^k/k! for k = 0..7. */
+#define E1  0.6931471805599453f
+#define E2  0.2402265069591007f
+#define E3  0.0555041086648216f
+#define E4  0.0096181291076285f
+#define E5  0.0013333558146428f
+#define E6  0.0001540353039338f
+#define E7  0.0000152527338040f
+
+__attribute__((target("sse2")))
+static inline __m128
+log2_sse2(__m128 x)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	__m128i xi = _mm_castps_si128(x);
+
+	/* Split x into exponent and mantissa in [sqrt(1/2), sqrt(2)). */
+	__m128i e = _mm_sub_epi32(_mm_srli_epi32(xi, 23),
+				  _mm_set1_epi32(127));
+	__m128 m = _mm_castsi128_ps(_mm_or_si128(
+		_mm_and_si128(xi, _mm_set1_epi32(0x007fffff)),
+		_mm_castps_si128(one)));
+	__m128 big = _mm_cmpgt_ps(m, _mm_set1_ps((float)M_SQRT2));
+	m = _mm_sub_ps(m, _mm_and_ps(big, _mm_mul_ps(m, _mm_set1_ps(0.5f))));
+	__m128 ef = _mm_add_ps(_mm_cvtepi32_ps(e), _mm_and_ps(big, one));
+
+	__m128 t = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+	__m128 t2 = _mm_mul_ps(t, t);
+	__m128 p = _mm_set1_ps(L9);
+	p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(L7));
+	p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(L5));
+	p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(L3));
+	p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(L1));
+
+	return _mm_add_ps(ef, _mm_mul_ps(p, t));
+}
+
+__attribute__((target("sse2")))
+static inline __m128
+exp2_sse2(__m128 z)
+{
+	/* Results below the normal range are flushed to zero. */
+	__m128 zero = _mm_cmplt_ps(z, _mm_set1_ps(-126.0f));
+	z = _mm_min_ps(z, _mm_set1_ps(127.0f));
+	z = _mm_max_ps(z, _mm_set1_ps(-126.0f));
+
+	/* Split z into integer n and fraction f in [-1/2, 1/2]. */
+	__m128i n = _mm_cvtps_epi32(z);
+	__m128 f = _mm_sub_ps(z, _mm_cvtepi32_ps(n));
+
+	__m128 p = _mm_set1_ps(E7);
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(E6));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(E5));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(E4));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(E3));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(E2));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(E1));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+
+	__m128 scale = _mm_castsi128_ps(_mm_slli_epi32(
+		_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+	return _mm_andnot_ps(zero, _mm_mul_ps(p, scale));
+}
+
+/* Power function for x >= FLT_MIN. Lanes with smaller x are returned in
+   the small mask so the caller can fall back to the scalar path. */
+__attribute__((target("sse2")))
+static inline __m128
+pow_sse2(__m128 x, __m128 exponent, __m128 *small)
+{
+	*small = _mm_cmplt_ps(x, _mm_set1_ps(FLT_MIN));
+	__m128 r = exp2_sse2(_mm_mul_ps(exponent, log2_sse2(x)));
+	return _mm_andnot_ps(*small, r);
+}
+
+__attribute__((target("sse2")))
+static int
+pow_u16_sse2(uint16_t *ramp, int size, float scale, float exponent)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i bias = _mm_set1_epi32(0x8000);
+	const __m128 vscale = _mm_set1_ps(scale);
+	const __m128 vexp = _mm_set1_ps(exponent);
+	const __m128 out_scale = _mm_set1_ps(UINT16_MAX+1);
+	const __m128 out_max = _mm_set1_ps(UINT16_MAX);
+
+	int i = 0;
+	for (; i + 8 <= size; i += 8) {
+		__m128i y = _mm_loadu_si128((const __m128i *)&ramp[i]);
+		__m128 x_lo = _mm_mul_ps(
+			_mm_cvtepi32_ps(_mm_unpacklo_epi16(y, zero)), vscale);
+		__m128 x_hi = _mm_mul_ps(
+			_mm_cvtepi32_ps(_mm_unpackhi_epi16(y, zero)), vscale);
+
+		__m128 small_lo, small_hi;
+		__m128 r_lo = pow_sse2(x_lo, vexp, &small_lo);
+		__m128 r_hi = pow_sse2(x_hi, vexp, &small_hi);
+
+		/* Zero is the only input in the integer ramps that can
+		   fall below FLT_MIN, and it maps to zero. */
+		r_lo = _mm_min_ps(_mm_mul_ps(r_lo, out_scale), out_max);
+		r_hi = _mm_min_ps(_mm_mul_ps(r_hi, out_scale), out_max);
+
+		/* Pack to unsigned 16-bit using signed saturation. */
+		__m128i v_lo = _mm_sub_epi32(_mm_cvttps_epi32(r_lo), bias);
+		__m128i v_hi = _mm_sub_epi32(_mm_cvttps_epi32(r_hi), bias);
+		__m128i v = _mm_xor_si128(_mm_packs_epi32(v_lo, v_hi),
+					  _mm_set1_epi16((short)0x8000));
+		_mm_storeu_si128((__m128i *)&ramp[i], v);
+	}
+
+	return i;
+}
+
+/* Recompute the lanes of x in mask with the scalar power function. */
+__attribute__((target("sse2")))
+static void
+pow_float_fixup(float *ramp, __m128 x, int mask, float exponent)
+{
+	float v[4];
+	_mm_storeu_ps(v, x);
+	for (int k = 0; k < 4; k++) {
+		if (mask & (1 << k)) ramp[k] = pow(v[k], exponent);
+	}
+}
+
+__attribute__((target("sse2")))
+static int
+pow_float_sse2(float *ramp, int size, float scale, float exponent)
+{
+	const __m128 vscale = _mm_set1_ps(scale);
+	const __m128 vexp = _mm_set1_ps(exponent);
+
+	int i = 0;
+	for (; i + 4 <= size; i += 4) {
+		__m128 x = _mm_mul_ps(_mm_loadu_ps(&ramp[i]), vscale);
+		__m128 small;
+		__m128 r = pow_sse2(x, vexp, &small);
+		int mask = _mm_movemask_ps(small);
+		_mm_storeu_ps(&ramp[i], r);
+
+		/* Tiny, zero and negative values are done in scalar. */
+		if (mask != 0) pow_float_fixup(&ramp[i], x, mask, exponent);
+	}
+
+	return i;
+}
+
+__attribute__((target("avx2")))
+static inline __m256
+log2_avx2(__m256 x)
+{
+	const __m256 one = _mm256_set1_ps(1.0f);
+	__m256i xi = _mm256_castps_si256(x);
+
+	/* Split x into exponent and mantissa in [sqrt(1/2), sqrt(2)). */
+	__m256i e = _mm256_sub_epi32(_mm256_srli_epi32(xi, 23),
+				     _mm256_set1_epi32(127));
+	__m256 m = _mm256_castsi256_ps(_mm256_or_si256(
+		_mm256_and_si256(xi, _mm256_set1_epi32(0x007fffff)),
+		_mm256_castps_si256(one)));
+	__m256 big = _mm256_cmp_ps(m, _mm256_set1_ps((float)M_SQRT2),
+				   _CMP_GT_OQ);
+	m = _mm256_sub_ps(m, _mm256_and_ps(
+		big, _mm256_mul_ps(m, _mm256_set1_ps(0.5f))));
+	__m256 ef = _mm256_add_ps(_mm256_cvtepi32_ps(e),
+				  _mm256_and_ps(big, one));
+
+	__m256 t = _mm256_div_ps(_mm256_sub_ps(m, one),
+				 _mm256_add_ps(m, one));
+	__m256 t2 = _mm256_mul_ps(t, t);
+	__m256 p = _mm256_set1_ps(L9);
+	p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(L7));
+	p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(L5));
+	p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(L3));
+	p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(L1));
+
+	return _mm256_add_ps(ef, _mm256_mul_ps(p, t));
+}
+
+__attribute__((target("avx2")))
+static inline __m256
+exp2_avx2(__m256 z)
+{
+	/* Results below the normal range are flushed to zero. */
+	__m256 zero = _mm256_cmp_ps(z, _mm256_set1_ps(-126.0f), _CMP_LT_OQ);
+	z = _mm256_min_ps(z, _mm256_set1_ps(127.0f));
+	z = _mm256_max_ps(z, _mm256_set1_ps(-126.0f));
+
+	/* Split z into integer n and fraction f in [-1/2, 1/2]. */
+	__m256i n = _mm256_cvtps_epi32(z);
+	__m256 f = _mm256_sub_ps(z, _mm256_cvtepi32_ps(n));
+
+	__m256 p = _mm256_set1_ps(E7);
+	p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(E6));
+	p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(E5));
+	p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(E4));
+	p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(E3));
+	p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(E2));
+	p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(E1));
+	p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.0f));
+
+	__m256 scale = _mm256_castsi256_ps(_mm256_slli_epi32(
+		_mm256_add_epi32(n, _mm256_set1_epi32(127)), 23));
+	return _mm256_andnot_ps(zero, _mm256_mul_ps(p, scale));
+}
+
+__attribute__((target("avx2")))
+static inline __m256
+pow_avx2(__m256 x, __m256 exponent, __m256 *small)
+{
+	*small = _mm256_cmp_ps(x, _mm256_set1_ps(FLT_MIN), _CMP_LT_OQ);
+	__m256 r = exp2_avx2(_mm256_mul_ps(exponent, log2_avx2(x)));
+	return _mm256_andnot_ps(*small, r);
+}
+
+__attribute__((target("avx2")))
+static int
+pow_u16_avx2(uint16_t *ramp, int size, float scale, float exponent)
+{
+	const __m256 vscale = _mm256_set1_ps(scale);
+	const __m256 vexp = _mm256_set1_ps(exponent);
+	const __m256 out_scale = _mm256_set1_ps(UINT16_MAX+1);
+	const __m256 out_max = _mm256_set1_ps(UINT16_MAX);
+
+	int i = 0;
+	for (; i + 8 <= size; i += 8) {
+		__m128i y = _mm_loadu_si128((const __m128i *)&ramp[i]);
+		__m256 x = _mm256_mul_ps(
+			_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(y)), vscale);
+
+		/* Zero is the only input in the integer ramps that can
+		   fall below FLT_MIN, and it maps to zero. */
+		__m256 small;
+		__m256 r = pow_avx2(x, vexp, &small);
+		r = _mm256_min_ps(_mm256_mul_ps(r, out_scale), out_max);
+
+		__m256i v = _mm256_cvttps_epi32(r);
+		__m128i packed = _mm_packus_epi32(
+			_mm256_castsi256_si128(v),
+			_mm256_extracti128_si256(v, 1));
+		_mm_storeu_si128((__m128i *)&ramp[i], packed);
+	}
+
+	return i;
+}
+
+__attribute__((target("avx2")))
+static int
+pow_float_avx2(float *ramp, int size, float scale, float exponent)
+{
+	const __m256 vscale = _mm256_set1_ps(scale);
+	const __m256 vexp = _mm256_set1_ps(exponent);
+
+	int i = 0;
+	for (; i + 8 <= size; i += 8) {
+		__m256 x = _mm256_mul_ps(_mm256_loadu_ps(&ramp[i]), vscale);
+		__m256 small;
+		__m256 r = pow_avx2(x, vexp, &small);
+		int mask = _mm256_movemask_ps(small);
+		_mm256_storeu_ps(&ramp[i], r);
+
+		/* Tiny, zero and negative values are done in scalar. */
+		if (mask != 0) {
+			pow_float_fixup(&ramp[i], _mm256_castps256_ps128(x),
+					mask & 0xf, exponent);
+			pow_float_fixup(&ramp[i+4],
+					_mm256_extractf128_ps(x, 1),
+					mask >> 4, exponent);
+		}
+	}
+
+	return i;
+}
+
+#undef L1
+#undef L3
+#undef L5
+#undef L7
+#undef L9
+#undef E1
+#undef E2
+#undef E3
+#undef E4
+#undef E5
+#undef E6
+#undef E7
+
+/* Best vector instruction set supported by the processor. */
+typedef enum {
+	SIMD_NONE = 0,
+	SIMD_SSE2,
+	SIMD_AVX2
+} simd_level_t;
+
+static int simd_level = -1;
+
+static simd_level_t
+get_simd_level(void)
+{
+	if (simd_level < 0) {
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			simd_level = SIMD_AVX2;
+		} else if (__builtin_cpu_supports("sse2")) {
+			simd_level = SIMD_SSE2;
+		} else {
+			simd_level = SIMD_NONE;
+		}
+	}
+
+	return simd_level;
+}
+
+#ifdef DEBUG_SIMD
+/* Use vector kernels up to level, where 0 is the double precision
+   path. Returns the level in use. */
+int
+colorramp_set_simd_level(int level)
+{
+	simd_level = -1;
+	if (level < get_simd_level()) simd_level = level;
+	return simd_level;
+}
+#endif
+
+static int
+simd_pow_u16(uint16_t *ramp, int size, float scale, float exponent)
+{
+	switch (get_simd_level()) {
+	case SIMD_AVX2:
+		return pow_u16_avx2(ramp, size, scale, exponent);
+	case SIMD_SSE2:
+		return pow_u16_sse2(ramp, size, scale, exponent);
+	default:
+		return 0;
+	}
+}
+
+static int
+simd_pow_float(float *ramp, int size, float scale, float exponent)
+{
+	switch (get_simd_level()) {
+	case SIMD_AVX2:
+		return pow_float_avx2(ramp, size, scale, exponent);
+	case SIMD_SSE2:
+		return pow_float_sse2(ramp, size, scale, exponent);
+	default:
+		return 0;
+	}
+}
+
+#else /* ! COLORRAMP_X86_SIMD */
+
+#ifdef DEBUG_SIMD
+int
+colorramp_set_simd_level(int level)
+{
+	return 0;
+}
+#endif
+
+static int
+simd_pow_u16(uint16_t *ramp, int size, float scale, float exponent)
+{
+	return 0;
+}
+
+static int
+simd_pow_float(float *ramp, int size, float scale, float exponent)
+{
+	return 0;
+}
+
+#endif /* ! COLORRAMP_X86_SIMD */
+
 /* Helper macro used in the fill functions */
 #define F(Y, C)  pow((Y) * setting->brightness * \
 		     white_point[C], 1.0/setting->gamma[C])
@@ -291,18 +779,20 @@ colorramp_fill(uint16_t *gamma_r, uint16_t *gamma_g, uint16_t *gamma_b,
 {
 	/* Approximate white point */
 	float white_point[3];
-	float alpha = (setting->temperature % 100) / 100.0;
-	int temp_index = ((setting->temperature - 1000) / 100)*3;
-	interpolate_color(alpha, &blackbody_color[temp_index],
-			  &blackbody_color[temp_index+3], white_point);
+	colorramp_get_white_point(setting, white_point);
 
-	for (int i = 0; i < size; i++) {
-		gamma_r[i] = F((double)gamma_r[i]/(UINT16_MAX+1), 0) *
-			(UINT16_MAX+1);
-		gamma_g[i] = F((double)gamma_g[i]/(UINT16_MAX+1), 1) *
-			(UINT16_MAX+1);
-		gamma_b[i] = F((double)gamma_b[i]/(UINT16_MAX+1), 2) *
-			(UINT16_MAX+1);
+	uint16_t *gamma[3] = { gamma_r, gamma_g, gamma_b };
+	for (int c = 0; c < 3; c++) {
+		/* Vector kernel handles as much of the ramp as it can,
+		   the remaining values are computed below. */
+		int i = simd_pow_u16(
+			gamma[c], size,
+			setting->brightness*white_point[c]/(UINT16_MAX+1),
+			1.0/setting->gamma[c]);
+		for (; i < size; i++) {
+			gamma[c][i] = F((double)gamma[c][i]/(UINT16_MAX+1),
+					c) * (UINT16_MAX+1);
+		}
 	}
 }
 
@@ -312,15 +802,182 @@ colorramp_fill_float(float *gamma_r, float *gamma_g, float *gamma_b,
 {
 	/* Approximate white point */
 	float white_point[3];
-	float alpha = (setting->temperature % 100) / 100.0;
-	int temp_index = ((setting->temperature - 1000) / 100)*3;
-	interpolate_color(alpha, &blackbody_color[temp_index],
-			  &blackbody_color[temp_index+3], white_point);
+	colorramp_get_white_point(setting, white_point);
 
-	for (int i = 0; i < size; i++) {
-		gamma_r[i] = F((double)gamma_r[i], 0);
-		gamma_g[i] = F((double)gamma_g[i], 1);
-		gamma_b[i] = F((double)gamma_b[i], 2);
+	float *gamma[3] = { gamma_r, gamma_g, gamma_b };
+	for (int c = 0; c < 3; c++) {
+		int i = simd_pow_float(
+			gamma[c], size, setting->brightness*white_point[c],
+			1.0/setting->gamma[c]);
+		for (; i < size; i++) {
+			gamma[c][i] = F((double)gamma[c][i], c);
+		}
+	}
+}
+
+/* The pure ramps are filled using the separable form of F:
+   pow(Y*s, 1/g) = pow(Y, 1/g) * pow(s, 1/g), where the first factor is
+   the cached base curve and the second is a scalar per channel. */
+
+void
+colorramp_fill_pure(uint16_t *gamma_r, uint16_t *gamma_g, uint16_t *gamma_b,
+		    int size, const color_setting_t *setting)
+{
+	/* Approximate white point */
+	float white_point[3];
+	colorramp_get_white_point(setting, white_point);
+
+	uint16_t *gamma[3] = { gamma_r, gamma_g, gamma_b };
+	for (int c = 0; c < 3; c++) {
+		const double *curve = get_pure_curve(
+			size, setting->gamma[c], 0);
+		if (curve == NULL) {
+			/* Fall back to computing each value */
+			for (int i = 0; i < size; i++) {
+				double y = pure_ramp_value(i, size, 0);
+				gamma[c][i] = F(y, c) * (UINT16_MAX+1);
+			}
+			continue;
+		}
+
+		double scale = F(1.0, c) * (UINT16_MAX+1);
+		for (int i = 0; i < size; i++) {
+			gamma[c][i] = curve[i] * scale;
+		}
+	}
+}
+
+void
+colorramp_fill_pure_float(float *gamma_r, float *gamma_g, float *gamma_b,
+			  int size, const color_setting_t *setting)
+{
+	/* Approximate white point */
+	float white_point[3];
+	colorramp_get_white_point(setting, white_point);
+
+	float *gamma[3] = { gamma_r, gamma_g, gamma_b };
+	for (int c = 0; c < 3; c++) {
+		const double *curve = get_pure_curve(
+			size, setting->gamma[c], 1);
+		if (curve == NULL) {
+			/* Fall back to computing each value */
+			for (int i = 0; i < size; i++) {
+				double y = pure_ramp_value(i, size, 1);
+				gamma[c][i] = F(y, c);
+			}
+			continue;
+		}
+
+		double scale = F(1.0, c);
+		for (int i = 0; i < size; i++) {
+			gamma[c][i] = curve[i] * scale;
+		}
+	}
+}
+
+/* Base curve of saved ramps. Holds pow(Y, 1/gamma) for each saved
+   value Y so that preserving the saved ramps only needs to scale the
+   curve by pow(s, 1/gamma), like the pure ramps. The saved ramps are
+   resampled if the output ramps have a different size. */
+void
+colorramp_base_init(colorramp_base_t *base, const uint16_t *source,
+		    int source_size)
+{
+	base->source = source;
+	base->source_size = source_size;
+	base->size = 0;
+	base->curve = NULL;
+}
+
+void
+colorramp_base_free(colorramp_base_t *base)
+{
+	free(base->curve);
+	base->curve = NULL;
+	base->size = 0;
+}
+
+/* Value at index i of saved ramp of channel c resampled to size. */
+static double
+base_source_value(const colorramp_base_t *base, int c, int i, int size)
+{
+	const uint16_t *ramp = &base->source[c*base->source_size];
+	if (size == base->source_size) {
+		return (double)ramp[i]/(UINT16_MAX+1);
+	}
+
+	double pos = size > 1 ?
+		(double)i*(base->source_size-1)/(size-1) : 0.0;
+	int j = pos;
+	if (j >= base->source_size-1) {
+		return (double)ramp[base->source_size-1]/(UINT16_MAX+1);
+	}
+	double a = pos - j;
+	return ((1.0-a)*ramp[j] + a*ramp[j+1])/(UINT16_MAX+1);
+}
+
+/* Compute base curve for size and the gamma of setting unless it is
+   already computed. Return -1 if memory could not be allocated. */
+static int
+base_update(colorramp_base_t *base, int size,
+	    const color_setting_t *setting)
+{
+	if (base->curve != NULL && base->size == size &&
+	    base->gamma[0] == setting->gamma[0] &&
+	    base->gamma[1] == setting->gamma[1] &&
+	    base->gamma[2] == setting->gamma[2]) {
+		return 0;
+	}
+
+	if (base->curve == NULL || base->size != size) {
+		double *curve = realloc(base->curve,
+					3*size*sizeof(double));
+		if (curve == NULL) return -1;
+		base->curve = curve;
+	}
+
+	base->size = size;
+	for (int c = 0; c < 3; c++) {
+		base->gamma[c] = setting->gamma[c];
+		for (int i = 0; i < size; i++) {
+			base->curve[c*size + i] = pow(
+				base_source_value(base, c, i, size),
+				1.0/setting->gamma[c]);
+		}
+	}
+
+	return 0;
+}
+
+/* Fill gamma ramps of size for setting applied on top of the saved
+   ramps of base. */
+void
+colorramp_fill_base(uint16_t *gamma_r, uint16_t *gamma_g, uint16_t *gamma_b,
+		    int size, const color_setting_t *setting,
+		    colorramp_base_t *base)
+{
+	/* Approximate white point */
+	float white_point[3];
+	colorramp_get_white_point(setting, white_point);
+
+	int r = base_update(base, size, setting);
+
+	uint16_t *gamma[3] = { gamma_r, gamma_g, gamma_b };
+	for (int c = 0; c < 3; c++) {
+		if (r < 0) {
+			/* Fall back to computing each value */
+			for (int i = 0; i < size; i++) {
+				double y = base_source_value(base, c, i, size);
+				gamma[c][i] = F(y, c) * (UINT16_MAX+1);
+			}
+			continue;
+		}
+
+		const double *curve = &base->curve[c*size];
+		double scale = F(1.0, c) * (UINT16_MAX+1);
+		for (int i = 0; i < size; i++) {
+			gamma[c][i] = curve[i] * scale;
+		}
 	}
 }
 
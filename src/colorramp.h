@@ -24,9 +24,37 @@
 
 #include "redshift.h"
 
+/* Saved ramps with the base curve used to apply settings on top. */
+typedef struct {
+	const uint16_t *source;
+	int source_size;
+	/* Size and gamma of curve */
+	int size;
+	float gamma[3];
+	double *curve;
+} colorramp_base_t;
+
+void colorramp_get_white_point(const color_setting_t *setting,
+			       float *white_point);
 void colorramp_fill(uint16_t *gamma_r, uint16_t *gamma_g, uint16_t *gamma_b,
 		    int size, const color_setting_t *setting);
 void colorramp_fill_float(float *gamma_r, float *gamma_g, float *gamma_b,
 			  int size, const color_setting_t *setting);
+void colorramp_fill_pure(uint16_t *gamma_r, uint16_t *gamma_g,
+			 uint16_t *gamma_b, int size,
+			 const color_setting_t *setting);
+void colorramp_fill_pure_float(float *gamma_r, float *gamma_g,
+			       float *gamma_b, int size,
+			       const color_setting_t *setting);
+void colorramp_base_init(colorramp_base_t *base, const uint16_t *source,
+			 int source_size);
+void colorramp_base_free(colorramp_base_t *base);
+void colorramp_fill_base(uint16_t *gamma_r, uint16_t *gamma_g,
+			 uint16_t *gamma_b, int size,
+			 const color_setting_t *setting,
+			 colorramp_base_t *base);
+#ifdef DEBUG_SIMD
+int colorramp_set_simd_level(int level);
+#endif
 
 #endif /* ! REDSHIFT_COLORRAMP_H */
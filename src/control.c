@@ -0,0 +1,500 @@
+/* control.c -- Control socket source
+   This file is part of Redshift.
+
+   Redshift is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Redshift is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Redshift.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* The control socket is a Unix domain stream socket watched by the
+   main loop. Clients send commands as lines of text and get a line
+   back for each command, starting with `OK' or `ERROR':
+
+     status                       Print status, period and setting
+     toggle                       Toggle adjustment as SIGUSR1 does
+     set temperature TEMP|auto    Override color temperature
+     set brightness BRIGHT|auto   Override brightness
+     pause MINUTES                Disable adjustment for a while,
+                                  or resume it if MINUTES is 0
+     reload                       Reload the configuration file
+
+   Commands change state that is read by the main loop, which runs
+   right after the commands are handled. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+
+#ifndef _WIN32
+# include <fcntl.h>
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/socket.h>
+# include <sys/un.h>
+#endif
+
+#if defined(HAVE_SIGNAL_H) && !defined(__WIN32__)
+# include <signal.h>
+#endif
+
+#ifdef ENABLE_NLS
+# include <libintl.h>
+# define _(s) gettext(s)
+#else
+# define _(s) s
+#endif
+
+#include "control.h"
+#include "eventloop.h"
+#include "signals.h"
+#include "systemtime.h"
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL  0
+#endif
+
+/* Largest number of clients connected at the same time. */
+#define CONTROL_MAX_CLIENTS  8
+/* Longest command line accepted. */
+#define CONTROL_LINE_MAX     256
+/* Longest reply line. */
+#define CONTROL_REPLY_MAX    256
+
+
+typedef struct {
+	int fd;
+	char line[CONTROL_LINE_MAX];
+	size_t length;
+} control_client_t;
+
+#ifndef _WIN32
+static const char *period_names[] = {
+	"none", "daytime", "night", "transition"
+};
+
+static int listen_fd = -1;
+static char *socket_path = NULL;
+static control_client_t clients[CONTROL_MAX_CLIENTS];
+
+static control_reload_func *reload_func = NULL;
+static void *reload_data = NULL;
+#endif
+
+/* Overrides set by commands. Negative temperature and NAN brightness
+   follow the transition scheme. */
+static int temperature_override = -1;
+static float brightness_override = NAN;
+/* Monotonic time at which a pause ends, or NAN if not paused. */
+static double pause_end = NAN;
+
+/* Status last published by the main loop. */
+static period_t status_period = PERIOD_NONE;
+static double status_progress = 0.0;
+static color_setting_t status_setting;
+static int status_disabled = 0;
+
+
+#ifndef _WIN32
+/* Set fd non-blocking and close-on-exec. */
+static int
+set_fd_flags(int fd)
+{
+	int flags = fcntl(fd, F_GETFL);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		perror("fcntl");
+		return -1;
+	}
+
+	if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
+		perror("fcntl");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Return 1 if another process listens on the socket at addr. */
+static int
+socket_in_use(const struct sockaddr_un *addr)
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return 0;
+
+	int r = connect(fd, (const struct sockaddr *)addr, sizeof(*addr));
+	close(fd);
+
+	return r == 0;
+}
+#endif
+
+/* Listen for commands on Unix domain socket at path. The reload
+   function is called for the reload command. */
+int
+control_init(const char *path, control_reload_func *reload, void *data)
+{
+#ifndef _WIN32
+	for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+		clients[i].fd = -1;
+	}
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, _("Control socket path `%s' is too long.\n"),
+			path);
+		return -1;
+	}
+
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	/* Replace socket left behind by an instance that is gone, but
+	   never remove anything that is not a socket. */
+	struct stat st;
+	int r = lstat(path, &st);
+	if (r == 0) {
+		if (!S_ISSOCK(st.st_mode)) {
+			fprintf(stderr, _("Control socket path `%s' exists"
+					  " and is not a socket.\n"), path);
+			return -1;
+		} else if (socket_in_use(&addr)) {
+			fprintf(stderr, _("Control socket `%s' is already"
+					  " in use.\n"), path);
+			return -1;
+		}
+
+		r = unlink(path);
+		if (r < 0) {
+			perror("unlink");
+			return -1;
+		}
+	} else if (errno != ENOENT) {
+		perror("lstat");
+		return -1;
+	}
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	/* Only the user may connect. */
+	mode_t mask = umask(0077);
+	r = bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+	if (r < 0) {
+		perror("bind");
+		close(listen_fd);
+		listen_fd = -1;
+		return -1;
+	}
+
+	socket_path = strdup(path);
+	if (socket_path == NULL) {
+		perror("strdup");
+		control_free();
+		return -1;
+	}
+
+	r = listen(listen_fd, CONTROL_MAX_CLIENTS);
+	if (r < 0) {
+		perror("listen");
+		control_free();
+		return -1;
+	}
+
+	r = set_fd_flags(listen_fd);
+	if (r < 0) {
+		control_free();
+		return -1;
+	}
+
+	reload_func = reload;
+	reload_data = data;
+
+	return 0;
+#else
+	fputs(_("Control socket is not supported on this platform.\n"),
+	      stderr);
+	return -1;
+#endif
+}
+
+#ifndef _WIN32
+static void
+close_client(control_client_t *client)
+{
+	eventloop_remove_fd(client->fd);
+	close(client->fd);
+	client->fd = -1;
+	client->length = 0;
+}
+#endif
+
+void
+control_free(void)
+{
+#ifndef _WIN32
+	for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+		if (clients[i].fd >= 0) close_client(&clients[i]);
+	}
+
+	if (listen_fd >= 0) {
+		eventloop_remove_fd(listen_fd);
+		close(listen_fd);
+		listen_fd = -1;
+	}
+
+	if (socket_path != NULL) {
+		unlink(socket_path);
+		free(socket_path);
+		socket_path = NULL;
+	}
+#endif
+}
+
+/* Return fd to watch for connections, or -1 if not listening. */
+int
+control_get_fd(void)
+{
+#ifndef _WIN32
+	return listen_fd;
+#else
+	return -1;
+#endif
+}
+
+#ifndef _WIN32
+static void
+format_status(char *reply, size_t size)
+{
+	double now;
+	double pause = 0.0;
+	if (systemtime_get_monotonic(&now) == 0) {
+		pause = control_get_pause(now);
+	}
+
+	const char *status = status_disabled ? "disabled" :
+		(pause > 0.0 ? "paused" : "enabled");
+	snprintf(reply, size,
+		 "OK status=%s period=%s progress=%.2f temperature=%d"
+		 " brightness=%.2f pause=%.0f\n",
+		 status, period_names[status_period], status_progress,
+		 status_setting.temperature, status_setting.brightness,
+		 ceil(pause));
+}
+
+/* Run one command line and write reply line. */
+static void
+run_command(char *line, char *reply, size_t size)
+{
+	char *saveptr = NULL;
+	char *command = strtok_r(line, " \t\r", &saveptr);
+	char *arg1 = strtok_r(NULL, " \t\r", &saveptr);
+	char *arg2 = strtok_r(NULL, " \t\r", &saveptr);
+	char *end;
+
+	snprintf(reply, size, "OK\n");
+
+	if (command == NULL) {
+		snprintf(reply, size, "ERROR empty command\n");
+	} else if (strcasecmp(command, "status") == 0) {
+		format_status(reply, size);
+	} else if (strcasecmp(command, "toggle") == 0) {
+		disable = 1;
+	} else if (strcasecmp(command, "set") == 0 &&
+		   arg1 != NULL && arg2 != NULL &&
+		   strcasecmp(arg1, "temperature") == 0) {
+		if (strcasecmp(arg2, "auto") == 0) {
+			temperature_override = -1;
+			return;
+		}
+
+		errno = 0;
+		long temp = strtol(arg2, &end, 10);
+		if (errno != 0 || end == arg2 || *end != '\0' ||
+		    temp < MIN_TEMP || temp > MAX_TEMP) {
+			snprintf(reply, size, "ERROR temperature must be"
+				 " between %d and %d\n", MIN_TEMP, MAX_TEMP);
+			return;
+		}
+		temperature_override = temp;
+	} else if (strcasecmp(command, "set") == 0 &&
+		   arg1 != NULL && arg2 != NULL &&
+		   strcasecmp(arg1, "brightness") == 0) {
+		if (strcasecmp(arg2, "auto") == 0) {
+			brightness_override = NAN;
+			return;
+		}
+
+		errno = 0;
+		double brightness = strtod(arg2, &end);
+		if (errno != 0 || end == arg2 || *end != '\0' ||
+		    !(brightness >= MIN_BRIGHTNESS &&
+		      brightness <= MAX_BRIGHTNESS)) {
+			snprintf(reply, size, "ERROR brightness must be"
+				 " between %.1f and %.1f\n",
+				 MIN_BRIGHTNESS, MAX_BRIGHTNESS);
+			return;
+		}
+		brightness_override = brightness;
+	} else if (strcasecmp(command, "pause") == 0 && arg1 != NULL) {
+		errno = 0;
+		double minutes = strtod(arg1, &end);
+		double now;
+		if (errno != 0 || end == arg1 || *end != '\0' ||
+		    !(minutes >= 0.0)) {
+			snprintf(reply, size, "ERROR invalid pause\n");
+			return;
+		}
+		if (systemtime_get_monotonic(&now) < 0) {
+			snprintf(reply, size, "ERROR unable to read time\n");
+			return;
+		}
+		pause_end = minutes > 0.0 ? now + minutes*60.0 : NAN;
+	} else if (strcasecmp(command, "reload") == 0) {
+		if (reload_func == NULL || reload_func(reload_data) < 0) {
+			snprintf(reply, size, "ERROR reload failed\n");
+		}
+	} else {
+		snprintf(reply, size, "ERROR unknown command\n");
+	}
+}
+
+static void
+accept_client(void)
+{
+	int fd = accept(listen_fd, NULL, NULL);
+	if (fd < 0) return;
+
+	for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+		control_client_t *client = &clients[i];
+		if (client->fd >= 0) continue;
+
+		if (set_fd_flags(fd) < 0 || eventloop_add_fd(fd) < 0) break;
+
+		client->fd = fd;
+		client->length = 0;
+		return;
+	}
+
+	/* No room for client */
+	close(fd);
+}
+
+/* Read commands from client and reply. */
+static void
+handle_client(control_client_t *client)
+{
+	while (1) {
+		ssize_t r = read(client->fd, client->line + client->length,
+				 CONTROL_LINE_MAX - client->length);
+		if (r < 0 && (errno == EAGAIN || errno == EINTR)) return;
+		if (r <= 0) {
+			close_client(client);
+			return;
+		}
+		client->length += r;
+
+		/* Run the complete lines. */
+		char *start = client->line;
+		char *newline;
+		while ((newline = memchr(start, '\n',
+					 client->line + client->length -
+					 start)) != NULL) {
+			*newline = '\0';
+
+			char reply[CONTROL_REPLY_MAX];
+			run_command(start, reply, sizeof(reply));
+			send(client->fd, reply, strlen(reply), MSG_NOSIGNAL);
+
+			start = newline + 1;
+		}
+
+		client->length -= start - client->line;
+		memmove(client->line, start, client->length);
+
+		if (client->length == CONTROL_LINE_MAX) {
+			const char *reply = "ERROR line too long\n";
+			send(client->fd, reply, strlen(reply), MSG_NOSIGNAL);
+			close_client(client);
+			return;
+		}
+	}
+}
+#endif
+
+/* Accept connections and run commands that are ready after the last
+   event loop wait. */
+void
+control_handle(void)
+{
+#ifndef _WIN32
+	if (listen_fd < 0) return;
+
+	for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+		control_client_t *client = &clients[i];
+		if (client->fd >= 0 && eventloop_is_ready(client->fd)) {
+			handle_client(client);
+		}
+	}
+
+	if (eventloop_is_ready(listen_fd)) accept_client();
+#endif
+}
+
+/* Replace parts of the target setting that are overridden. */
+void
+control_apply_overrides(color_setting_t *setting)
+{
+	if (temperature_override >= 0) {
+		setting->temperature = temperature_override;
+	}
+	if (!isnan(brightness_override)) {
+		setting->brightness = brightness_override;
+	}
+}
+
+/* Return seconds until a pause ends at monotonic time now, or zero if
+   not paused. */
+double
+control_get_pause(double now)
+{
+	if (isnan(pause_end)) return 0.0;
+	if (now >= pause_end) {
+		pause_end = NAN;
+		return 0.0;
+	}
+
+	return pause_end - now;
+}
+
+/* Publish the setting applied by the main loop for status. */
+void
+control_set_status(
+	period_t period, double progress, const color_setting_t *setting,
+	int disabled)
+{
+	status_period = period;
+	status_progress = progress;
+	status_setting = *setting;
+	status_disabled = disabled;
+}
@@ -0,0 +1,38 @@
+/* control.h -- Control socket header
+   This file is part of Redshift.
+
+   Redshift is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Redshift is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Redshift.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef REDSHIFT_CONTROL_H
+#define REDSHIFT_CONTROL_H
+
+#include "redshift.h"
+
+/* Reload settings for the reload command. Return -1 on failure, in
+   which case the running settings must be kept. */
+typedef int control_reload_func(void *data);
+
+int control_init(const char *path, control_reload_func *reload, void *data);
+void control_free(void);
+int control_get_fd(void);
+void control_handle(void);
+
+void control_apply_overrides(color_setting_t *setting);
+double control_get_pause(double now);
+void control_set_status(
+	period_t period, double progress, const color_setting_t *setting,
+	int disabled);
+
+#endif /* ! REDSHIFT_CONTROL_H */
@@ -0,0 +1,106 @@
+/* drm-uevent.c -- Device events of graphics cards
+   This file is part of Redshift.
+
+   Redshift is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Redshift is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Redshift.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Parsing of the device events that the DRM method receives from the
+   udev monitor socket. Kept apart from the method so that it builds
+   without libdrm. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "drm-uevent.h"
+
+
+/* Parse card number from device name like `/dev/dri/card0'.
+   Return -1 if the name is not a card node. */
+int
+drm_parse_card_name(const char *name)
+{
+	const char *base = strrchr(name, '/');
+	base = base != NULL ? base + 1 : name;
+
+	if (strncmp(base, "card", 4) != 0) return -1;
+	base += 4;
+	if (*base < '0' || *base > '9') return -1;
+
+	int card_num = 0;
+	for (; *base != '\0'; base++) {
+		if (*base < '0' || *base > '9') return -1;
+		card_num = 10*card_num + (*base - '0');
+		if (card_num > 0xffff) return -1;
+	}
+
+	return card_num;
+}
+
+/* Parse device event message from the udev monitor socket, either
+   as forwarded by udev or as sent by the kernel. Return 1 if event
+   is about a graphics card, 0 if it is not and -1 if the message is
+   malformed. */
+int
+drm_parse_uevent(const char *buf, size_t len, drm_uevent_t *event)
+{
+	size_t offset;
+	size_t end = len;
+
+	event->action[0] = '\0';
+	event->card_num = -1;
+	event->hotplug = 0;
+
+	if (len >= 24 && memcmp(buf, "libudev", 8) == 0) {
+		/* Header of udev: prefix, magic, header size,
+		   properties offset and properties length. */
+		uint32_t properties_off, properties_len;
+		memcpy(&properties_off, buf + 16, sizeof(uint32_t));
+		memcpy(&properties_len, buf + 20, sizeof(uint32_t));
+		if (properties_off > len ||
+		    properties_len > len - properties_off) {
+			return -1;
+		}
+		offset = properties_off;
+		end = properties_off + properties_len;
+	} else {
+		/* Kernel message starts with ACTION@DEVPATH */
+		const char *header_end = memchr(buf, '\0', len);
+		if (header_end == NULL || strchr(buf, '@') == NULL) {
+			return -1;
+		}
+		offset = header_end - buf + 1;
+	}
+
+	int is_drm = 0;
+	while (offset < end) {
+		const char *line = buf + offset;
+		const char *line_end = memchr(line, '\0', end - offset);
+		if (line_end == NULL) return -1;
+		offset = line_end - buf + 1;
+
+		if (strncmp(line, "ACTION=", 7) == 0) {
+			strncpy(event->action, line + 7,
+				sizeof(event->action) - 1);
+			event->action[sizeof(event->action) - 1] = '\0';
+		} else if (strcmp(line, "SUBSYSTEM=drm") == 0) {
+			is_drm = 1;
+		} else if (strncmp(line, "DEVNAME=", 8) == 0) {
+			event->card_num = drm_parse_card_name(line + 8);
+		} else if (strcmp(line, "HOTPLUG=1") == 0) {
+			event->hotplug = 1;
+		}
+	}
+
+	return is_drm && event->card_num >= 0 && event->action[0] != '\0';
+}
@@ -0,0 +1,34 @@
+/* drm-uevent.h -- Device events of graphics cards header
+   This file is part of Redshift.
+
+   Redshift is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Redshift is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Redshift.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef REDSHIFT_DRM_UEVENT_H
+#define REDSHIFT_DRM_UEVENT_H
+
+#include <stddef.h>
+
+/* Device event of a graphics card */
+typedef struct {
+	char action[16];
+	int card_num;
+	/* Connectors may have changed */
+	int hotplug;
+} drm_uevent_t;
+
+int drm_parse_card_name(const char *name);
+int drm_parse_uevent(const char *buf, size_t len, drm_uevent_t *event);
+
+#endif /* ! REDSHIFT_DRM_UEVENT_H */
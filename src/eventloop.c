@@ -0,0 +1,499 @@
+/* eventloop.c -- Main loop event waiting source
+   This file is part of Redshift.
+
+   Redshift is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Redshift is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Redshift.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* The main loop waits for a timeout and for any of a set of fds to
+   become readable: the signal fd, and the fds of the gamma method and
+   location provider. With epoll the fds are registered once and the
+   timeout is kept by a timerfd with nanosecond resolution. Otherwise
+   the fds are polled with a timeout in milliseconds.
+
+   Time spent suspended counts towards the timeout, so that the main
+   loop does not keep showing a stale setting after resume. The timerfd
+   is on CLOCK_BOOTTIME where available, so a timeout that runs out
+   during suspend expires at resume. Poll does not count suspend, so
+   its timeout is split into slices and the wait ends after the slice
+   in which CLOCK_BOOTTIME drifted away from CLOCK_MONOTONIC. A wait
+   also ends when the wall clock is set, which is caught by a
+   CLOCK_REALTIME timerfd with TFD_TIMER_CANCEL_ON_SET. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef _WIN32
+# include <poll.h>
+#endif
+
+#ifdef ENABLE_NLS
+# include <libintl.h>
+# define _(s) gettext(s)
+#else
+# define _(s) s
+#endif
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H)
+# define EVENTLOOP_EPOLL  1
+# include <sys/epoll.h>
+# include <sys/timerfd.h>
+#endif
+
+#include "eventloop.h"
+#include "systemtime.h"
+
+/* Largest number of fds that can be watched. */
+#define EVENTLOOP_MAX_FDS  16
+
+/* Drift of CLOCK_BOOTTIME from CLOCK_MONOTONIC (seconds) during a wait
+   that is taken to mean that the system was suspended. */
+#define EVENTLOOP_SUSPEND_DRIFT  1.0
+
+/* Longest time (milliseconds) that poll waits before checking whether
+   the system was suspended. */
+#define EVENTLOOP_POLL_SLICE  5000
+
+/* Interval (seconds) at which the clock change timer is re-armed. It
+   only expires if the clock is never set for this long. */
+#define EVENTLOOP_CLOCK_REARM  (365*24*60*60)
+
+
+static int watched_fds[EVENTLOOP_MAX_FDS];
+static int watched_count = 0;
+
+/* Fds that were readable after the last wait. */
+static int ready_fds[EVENTLOOP_MAX_FDS];
+static int ready_count = 0;
+
+/* Set when the last wait was ended by a clock discontinuity. */
+static int clock_changed = 0;
+
+#ifdef EVENTLOOP_EPOLL
+static int epoll_fd = -1;
+static int timer_fd = -1;
+#endif
+
+#if defined(EVENTLOOP_EPOLL) && defined(TFD_TIMER_CANCEL_ON_SET)
+# define EVENTLOOP_CLOCK_FD  1
+static int clock_fd = -1;
+#endif
+
+
+/* Return the time the system has spent suspended, as the difference
+   between CLOCK_BOOTTIME and CLOCK_MONOTONIC, or -1 if unknown. */
+static double
+get_suspended_time(void)
+{
+#if defined(CLOCK_BOOTTIME) && defined(CLOCK_MONOTONIC)
+	struct timespec boot, mono;
+	if (clock_gettime(CLOCK_BOOTTIME, &boot) < 0 ||
+	    clock_gettime(CLOCK_MONOTONIC, &mono) < 0) {
+		return -1.0;
+	}
+
+	return (boot.tv_sec - mono.tv_sec) +
+		(boot.tv_nsec - mono.tv_nsec)/1000000000.0;
+#else
+	return -1.0;
+#endif
+}
+
+#ifdef EVENTLOOP_CLOCK_FD
+/* Arm timer that is cancelled when the wall clock is set. Return -1
+   if this is not supported by the kernel. */
+static int
+arm_clock_fd(void)
+{
+	struct timespec now;
+	int r = clock_gettime(CLOCK_REALTIME, &now);
+	if (r < 0) return -1;
+
+	struct itimerspec spec;
+	memset(&spec, 0, sizeof(spec));
+	spec.it_value.tv_sec = now.tv_sec + EVENTLOOP_CLOCK_REARM;
+
+	return timerfd_settime(clock_fd,
+			       TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+			       &spec, NULL);
+}
+
+/* Set up the clock change timer. It is optional, so failure only
+   leaves it out. */
+static void
+init_clock_fd(void)
+{
+	clock_fd = timerfd_create(CLOCK_REALTIME,
+				  TFD_NONBLOCK | TFD_CLOEXEC);
+	if (clock_fd < 0) return;
+
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = clock_fd;
+	if (arm_clock_fd() < 0 ||
+	    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, clock_fd, &event) < 0) {
+		close(clock_fd);
+		clock_fd = -1;
+	}
+}
+
+/* Read the clock change timer and re-arm it. Return 1 if the clock
+   was set. */
+static int
+handle_clock_fd(void)
+{
+	uint64_t expirations;
+	ssize_t r = read(clock_fd, &expirations, sizeof(expirations));
+	int changed = r < 0 && errno == ECANCELED;
+
+	if (arm_clock_fd() < 0) {
+		perror("timerfd_settime");
+		close(clock_fd);
+		clock_fd = -1;
+	}
+
+	return changed;
+}
+#endif
+
+
+/* Set up waiting for events. Falls back to poll if epoll or timerfd
+   are not available at runtime. */
+int
+eventloop_init(void)
+{
+	watched_count = 0;
+	ready_count = 0;
+
+#ifdef EVENTLOOP_EPOLL
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0) {
+		perror("epoll_create1");
+		return 0;
+	}
+
+	/* Kernels before 3.15 do not support CLOCK_BOOTTIME timers. */
+#ifdef CLOCK_BOOTTIME
+	timer_fd = timerfd_create(CLOCK_BOOTTIME,
+				  TFD_NONBLOCK | TFD_CLOEXEC);
+#endif
+	if (timer_fd < 0) {
+		timer_fd = timerfd_create(CLOCK_MONOTONIC,
+					  TFD_NONBLOCK | TFD_CLOEXEC);
+	}
+	if (timer_fd < 0) {
+		perror("timerfd_create");
+		close(epoll_fd);
+		epoll_fd = -1;
+		return 0;
+	}
+
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = timer_fd;
+	int r = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event);
+	if (r < 0) {
+		perror("epoll_ctl");
+		eventloop_free();
+		return -1;
+	}
+#endif
+
+#ifdef EVENTLOOP_CLOCK_FD
+	init_clock_fd();
+#endif
+
+	return 0;
+}
+
+void
+eventloop_free(void)
+{
+#ifdef EVENTLOOP_CLOCK_FD
+	if (clock_fd >= 0) {
+		close(clock_fd);
+		clock_fd = -1;
+	}
+#endif
+#ifdef EVENTLOOP_EPOLL
+	if (timer_fd >= 0) {
+		close(timer_fd);
+		timer_fd = -1;
+	}
+	if (epoll_fd >= 0) {
+		close(epoll_fd);
+		epoll_fd = -1;
+	}
+#endif
+
+	watched_count = 0;
+	ready_count = 0;
+	clock_changed = 0;
+}
+
+/* Wake up when fd becomes readable. Adding a negative fd does
+   nothing, so event sources without an fd need no special case. Each
+   fd must only be added once. */
+int
+eventloop_add_fd(int fd)
+{
+	if (fd < 0) return 0;
+
+	for (int i = 0; i < watched_count; i++) {
+		if (watched_fds[i] == fd) {
+			fprintf(stderr, _("File descriptor %d is already"
+					  " watched.\n"), fd);
+			return -1;
+		}
+	}
+
+	if (watched_count == EVENTLOOP_MAX_FDS) {
+		fputs(_("Too many file descriptors to watch.\n"), stderr);
+		return -1;
+	}
+
+#ifdef EVENTLOOP_EPOLL
+	if (epoll_fd >= 0) {
+		struct epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.fd = fd;
+		int r = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+		if (r < 0) {
+			perror("epoll_ctl");
+			return -1;
+		}
+	}
+#endif
+
+	watched_fds[watched_count++] = fd;
+
+	return 0;
+}
+
+/* Stop watching fd. Must be called before fd is closed. */
+void
+eventloop_remove_fd(int fd)
+{
+	for (int i = 0; i < watched_count; i++) {
+		if (watched_fds[i] != fd) continue;
+
+#ifdef EVENTLOOP_EPOLL
+		if (epoll_fd >= 0) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+
+		watched_fds[i] = watched_fds[--watched_count];
+		break;
+	}
+
+	for (int i = 0; i < ready_count; i++) {
+		if (ready_fds[i] == fd) {
+			ready_fds[i] = ready_fds[--ready_count];
+			break;
+		}
+	}
+}
+
+/* Watch new_fd instead of *fd, the fd watched for an event source or
+   -1, and store it in *fd. Does nothing if the fd is unchanged. */
+int
+eventloop_update_fd(int *fd, int new_fd)
+{
+	if (new_fd == *fd) return 0;
+
+	eventloop_remove_fd(*fd);
+	*fd = -1;
+
+	int r = eventloop_add_fd(new_fd);
+	if (r < 0) return -1;
+
+	*fd = new_fd;
+	return 0;
+}
+
+#ifdef EVENTLOOP_EPOLL
+static int
+wait_epoll(double timeout)
+{
+	/* The timer is disarmed by a zero value, so a zero timeout is
+	   rounded up to a nanosecond. */
+	struct itimerspec spec;
+	memset(&spec, 0, sizeof(spec));
+	if (timeout >= 0.0) {
+		spec.it_value.tv_sec = timeout;
+		spec.it_value.tv_nsec =
+			(timeout - spec.it_value.tv_sec)*1000000000.0;
+		if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+			spec.it_value.tv_nsec = 1;
+		}
+	}
+
+	int r = timerfd_settime(timer_fd, 0, &spec, NULL);
+	if (r < 0) {
+		perror("timerfd_settime");
+		return -1;
+	}
+
+	struct epoll_event events[EVENTLOOP_MAX_FDS+1];
+	r = epoll_wait(epoll_fd, events, EVENTLOOP_MAX_FDS+1, -1);
+	if (r < 0) {
+		if (errno == EINTR) return 0;
+		perror("epoll_wait");
+		return -1;
+	}
+
+	for (int i = 0; i < r; i++) {
+		if (events[i].data.fd == timer_fd) {
+			uint64_t expirations;
+			read(timer_fd, &expirations, sizeof(expirations));
+			continue;
+		}
+#ifdef EVENTLOOP_CLOCK_FD
+		if (events[i].data.fd == clock_fd) {
+			if (handle_clock_fd()) clock_changed = 1;
+			continue;
+		}
+#endif
+		ready_fds[ready_count++] = events[i].data.fd;
+	}
+
+	return ready_count;
+}
+#endif
+
+static int
+wait_poll(double timeout)
+{
+	int timeout_ms = -1;
+	if (timeout >= 0.0) {
+		timeout_ms = ceil(fmin(timeout*1000.0, INT_MAX));
+	}
+
+#ifndef _WIN32
+	struct pollfd pollfds[EVENTLOOP_MAX_FDS];
+	for (int i = 0; i < watched_count; i++) {
+		pollfds[i].fd = watched_fds[i];
+		pollfds[i].events = POLLIN;
+		pollfds[i].revents = 0;
+	}
+
+	double suspended_before = get_suspended_time();
+
+	int r;
+	while (1) {
+		int slice_ms = EVENTLOOP_POLL_SLICE;
+		if (timeout_ms >= 0 && timeout_ms < slice_ms) {
+			slice_ms = timeout_ms;
+		}
+
+		r = poll(pollfds, watched_count, slice_ms);
+		if (r != 0 || slice_ms == timeout_ms) break;
+		if (timeout_ms > 0) timeout_ms -= slice_ms;
+
+		/* End wait early after suspend */
+		double suspended_after = get_suspended_time();
+		if (suspended_before >= 0.0 && suspended_after >= 0.0 &&
+		    suspended_after - suspended_before >
+		    EVENTLOOP_SUSPEND_DRIFT) {
+			break;
+		}
+	}
+	if (r < 0) {
+		if (errno == EINTR) return 0;
+		perror("poll");
+		return -1;
+	}
+
+	for (int i = 0; i < watched_count; i++) {
+		if (pollfds[i].revents != 0) {
+			ready_fds[ready_count++] = pollfds[i].fd;
+		}
+	}
+#else
+	/* No event sources on Windows */
+	if (timeout_ms >= 0) systemtime_msleep(timeout_ms);
+#endif
+
+	return ready_count;
+}
+
+/* Wait until a watched fd is readable or until timeout (seconds) has
+   passed. A negative timeout waits for fds only. Return the number of
+   readable fds, zero on timeout, interruption or clock change, and -1
+   on error. */
+int
+eventloop_wait(double timeout)
+{
+	ready_count = 0;
+	clock_changed = 0;
+
+	double suspended_before = get_suspended_time();
+
+	/* The timeout is on the virtual clock when simulating. Time
+	   only passes on it when the wait runs out. */
+	double real_timeout = systemtime_get_real_timeout(timeout);
+
+	int r;
+#ifdef EVENTLOOP_EPOLL
+	if (epoll_fd >= 0) {
+		r = wait_epoll(real_timeout);
+	} else {
+		r = wait_poll(real_timeout);
+	}
+#else
+	r = wait_poll(real_timeout);
+#endif
+
+	if (r == 0) systemtime_advance(timeout);
+
+	double suspended_after = get_suspended_time();
+	if (suspended_before >= 0.0 && suspended_after >= 0.0 &&
+	    suspended_after - suspended_before > EVENTLOOP_SUSPEND_DRIFT) {
+		clock_changed = 1;
+	}
+
+	return r;
+}
+
+/* Return 1 if the last wait ended because the wall clock was set or
+   the system was suspended. */
+int
+eventloop_clock_changed(void)
+{
+	return clock_changed;
+}
+
+/* Return 1 if fd was readable after the last wait. */
+int
+eventloop_is_ready(int fd)
+{
+	if (fd < 0) return 0;
+
+	for (int i = 0; i < ready_count; i++) {
+		if (ready_fds[i] == fd) return 1;
+	}
+
+	return 0;
+}
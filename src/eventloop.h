@@ -0,0 +1,30 @@
+/* eventloop.h -- Main loop event waiting header
+   This file is part of Redshift.
+
+   Redshift is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Redshift is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Redshift.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef REDSHIFT_EVENTLOOP_H
+#define REDSHIFT_EVENTLOOP_H
+
+int eventloop_init(void);
+void eventloop_free(void);
+int eventloop_add_fd(int fd);
+void eventloop_remove_fd(int fd);
+int eventloop_update_fd(int *fd, int new_fd);
+int eventloop_wait(double timeout);
+int eventloop_is_ready(int fd);
+int eventloop_clock_changed(void);
+
+#endif /* ! REDSHIFT_EVENTLOOP_H */
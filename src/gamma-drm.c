@@ -18,6 +18,11 @@
    Copyright (c) 2017  Jon Lund Steffensen <jonlst@gmail.com>
 */
 
+/* struct ucred for the credentials of device events */
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
 #ifdef HAVE_CONFIG_H
 # include "config.h"
 #endif
@@ -26,10 +31,20 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <poll.h>
+
+#ifdef __linux__
+# include <sys/socket.h>
+# include <sys/epoll.h>
+# include <sys/timerfd.h>
+# include <linux/netlink.h>
+#endif
 
 #ifdef ENABLE_NLS
 # include <libintl.h>
@@ -46,8 +61,40 @@
 #include <xf86drmMode.h>
 
 #include "gamma-drm.h"
+#include "drm-uevent.h"
 #include "colorramp.h"
+#include "colorramp-cache.h"
+#include "systemtime.h"
+
+
+/* Largest atomic gamma LUT that is used */
+#define DRM_MAX_LUT_SIZE  65536
 
+/* Netlink group of device events that have been processed by udev */
+#define UDEV_MONITOR_GROUP  2
+#define UEVENT_BUFFER_SIZE  8192
+
+/* Updates further apart than this are not paced by vertical blanks
+   (seconds). Fade frames are at least this frequent. */
+#define DRM_VBLANK_MAX_INTERVAL  2.0
+
+/* After connectors change, the new modes are usually set a moment
+   later, so the CRTCs are checked again at this interval (seconds)
+   for a number of times. */
+#define DRM_RECHECK_INTERVAL  0.5
+#define DRM_RECHECK_COUNT     20
+
+
+/* How color temperature and brightness are applied */
+typedef enum {
+	/* Use CTM where available, gamma LUT otherwise */
+	GAMMA_DRM_MODE_AUTO,
+	/* Gamma LUT */
+	GAMMA_DRM_MODE_LUT,
+	/* Color transformation matrix. The gamma LUT only
+	   applies the gamma exponent. */
+	GAMMA_DRM_MODE_CTM
+} gamma_drm_mode_t;
 
 typedef struct {
 	int crtc_num;
@@ -56,14 +103,68 @@ typedef struct {
 	uint16_t* r_gamma;
 	uint16_t* g_gamma;
 	uint16_t* b_gamma;
+	/* Base curve of the saved ramps for preserve */
+	colorramp_base_t base;
+	/* Key of the ramps last applied to the CRTC */
+	colorramp_key_t applied;
+	/* CRTC has a valid mode */
+	int active;
+	/* Refresh rate of the mode, or zero if unknown */
+	int refresh;
+	/* GAMMA_LUT property and its size, or zero if the CRTC
+	   is updated with the legacy gamma ioctl. */
+	uint32_t gamma_lut_prop;
+	int lut_size;
+	/* Blob of pending atomic update */
+	uint32_t blob_id;
+	/* CTM property, or zero if the CTM is not used */
+	uint32_t ctm_prop;
+	/* CTM last applied to the CRTC */
+	struct drm_color_ctm ctm;
+	int ctm_applied;
+	uint32_t ctm_blob_id;
+	/* CTM property of a CTM that has been committed to the CRTC and
+	   not removed since, or zero. */
+	uint32_t ctm_committed_prop;
 } drm_crtc_state_t;
 
 typedef struct {
 	int card_num;
-	int crtc_num;
 	int fd;
 	drmModeRes* res;
 	drm_crtc_state_t* crtcs;
+	/* Vblank event has been requested */
+	int vblank_pending;
+	/* Monotonic time of the last update */
+	double last_update;
+} drm_card_state_t;
+
+typedef struct {
+	/* Selected card, or -1 for all cards */
+	int card_num;
+	int crtc_num;
+	gamma_drm_mode_t mode;
+	/* Pace updates by vertical blanks */
+	int vblank;
+	int save_ramps;
+	int card_count;
+	drm_card_state_t* cards;
+	/* Buffer for new gamma ramps, large enough for any CRTC. */
+	uint16_t* ramps;
+	int ramps_size;
+	/* Buffer for atomic gamma LUT, large enough for any CRTC. */
+	struct drm_color_lut* lut;
+	int lut_size;
+	/* Socket for udev device events, -1 if unavailable
+	   or -2 if not opened yet. */
+	int uevent_fd;
+	/* Set of the socket, the recheck timer and the card fds
+	   for the main loop, or -1 if not used. */
+	int poll_fd;
+	/* Timer of CRTC checks after connectors changed, -1 if
+	   unavailable, and the number of checks left. */
+	int recheck_fd;
+	int rechecks;
 } drm_state_t;
 
 
@@ -75,26 +176,173 @@ drm_init(drm_state_t **state)
 	if (*state == NULL) return -1;
 
 	drm_state_t *s = *state;
-	s->card_num = 0;
+	s->card_num = -1;
 	s->crtc_num = -1;
-	s->fd = -1;
-	s->res = NULL;
-	s->crtcs = NULL;
+	s->mode = GAMMA_DRM_MODE_AUTO;
+	s->vblank = 0;
+	s->save_ramps = 0;
+	s->card_count = 0;
+	s->cards = NULL;
+	s->ramps = NULL;
+	s->ramps_size = 0;
+	s->lut = NULL;
+	s->lut_size = 0;
+	s->uevent_fd = -2;
+	s->poll_fd = -1;
+	s->recheck_fd = -1;
+	s->rechecks = 0;
+
+	return 0;
+}
+
+/* Look up the GAMMA_LUT and CTM properties of CRTC for atomic
+   updates. */
+static void
+drm_get_color_props(drm_state_t *state, drm_card_state_t *card,
+		    drm_crtc_state_t *crtc)
+{
+	crtc->gamma_lut_prop = 0;
+	crtc->lut_size = 0;
+	crtc->ctm_prop = 0;
+
+	drmModeObjectProperties *props = drmModeObjectGetProperties(
+		card->fd, crtc->crtc_id, DRM_MODE_OBJECT_CRTC);
+	if (props == NULL) return;
+
+	uint32_t prop_id = 0;
+	uint32_t ctm_prop_id = 0;
+	uint64_t lut_size = 0;
+	for (uint32_t i = 0; i < props->count_props; i++) {
+		drmModePropertyRes *prop =
+			drmModeGetProperty(card->fd, props->props[i]);
+		if (prop == NULL) continue;
+
+		if (strcmp(prop->name, "GAMMA_LUT") == 0) {
+			prop_id = prop->prop_id;
+		} else if (strcmp(prop->name, "GAMMA_LUT_SIZE") == 0) {
+			lut_size = props->prop_values[i];
+		} else if (strcmp(prop->name, "CTM") == 0) {
+			ctm_prop_id = prop->prop_id;
+		}
+		drmModeFreeProperty(prop);
+	}
+	drmModeFreeObjectProperties(props);
+
+	if (prop_id != 0 && lut_size > 1 && lut_size <= DRM_MAX_LUT_SIZE) {
+		crtc->gamma_lut_prop = prop_id;
+		crtc->lut_size = lut_size;
+
+		/* The CTM is used along with the gamma LUT */
+		if (state->mode != GAMMA_DRM_MODE_LUT) {
+			crtc->ctm_prop = ctm_prop_id;
+		}
+	}
+}
+
+/* Free the state of card and close it. */
+static void
+drm_card_free(drm_card_state_t *card)
+{
+	if (card->crtcs != NULL) {
+		drm_crtc_state_t *crtcs = card->crtcs;
+		while (crtcs->crtc_num >= 0) {
+			colorramp_base_free(&crtcs->base);
+			free(crtcs->r_gamma);
+			crtcs->crtc_num = -1;
+			crtcs++;
+		}
+		free(card->crtcs);
+		card->crtcs = NULL;
+	}
+	if (card->res != NULL) {
+		drmModeFreeResources(card->res);
+		card->res = NULL;
+	}
+	if (card->fd >= 0) {
+		close(card->fd);
+		card->fd = -1;
+	}
+}
+
+/* Grow the shared ramp buffers to fit every CRTC of card. */
+static int
+drm_alloc_buffers(drm_state_t *state, drm_card_state_t *card)
+{
+	int max_gamma_size = 0;
+	int max_lut_size = 0;
+	for (drm_crtc_state_t *crtcs = card->crtcs;
+	     crtcs->crtc_num >= 0; crtcs++) {
+		if (crtcs->gamma_size > max_gamma_size)
+			max_gamma_size = crtcs->gamma_size;
+		if (crtcs->lut_size > max_lut_size)
+			max_lut_size = crtcs->lut_size;
+	}
+	if (max_lut_size > max_gamma_size)
+		max_gamma_size = max_lut_size;
+
+	if (max_gamma_size > state->ramps_size) {
+		uint16_t *ramps = realloc(state->ramps,
+					  3 * max_gamma_size * sizeof(uint16_t));
+		if (ramps == NULL) {
+			perror("malloc");
+			return -1;
+		}
+		state->ramps = ramps;
+		state->ramps_size = max_gamma_size;
+	}
+	if (max_lut_size > state->lut_size) {
+		struct drm_color_lut *lut = realloc(
+			state->lut, max_lut_size * sizeof(struct drm_color_lut));
+		if (lut == NULL) {
+			perror("malloc");
+			return -1;
+		}
+		state->lut = lut;
+		state->lut_size = max_lut_size;
+	}
 
 	return 0;
 }
 
+/* Add fd to the set of fds that the main loop waits for. */
+static void
+drm_watch_fd(drm_state_t *state, int fd)
+{
+#ifdef __linux__
+	if (state->poll_fd < 0 || fd < 0) return;
+
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = fd;
+	int r = epoll_ctl(state->poll_fd, EPOLL_CTL_ADD, fd, &event);
+	if (r < 0) perror("epoll_ctl");
+#endif
+}
+
+/* Open graphics card and load its CRTCs. The card is added to the
+   list of cards. If quiet is set, missing mode resources and CRTCs
+   are not reported, since not every card drives displays. Return -1
+   if the card could not be used. */
 static int
-drm_start(drm_state_t *state)
+drm_card_open(drm_state_t *state, int card_num, int quiet)
 {
+	drm_card_state_t card_state;
+	drm_card_state_t *card = &card_state;
+	card->card_num = card_num;
+	card->res = NULL;
+	card->crtcs = NULL;
+	card->vblank_pending = 0;
+	card->last_update = 0.0;
+
 	/* Acquire access to a graphics card. */
 	long maxlen = strlen(DRM_DIR_NAME) + strlen(DRM_DEV_NAME) + 10;
 	char pathname[maxlen];
 
-	sprintf(pathname, DRM_DEV_NAME, DRM_DIR_NAME, state->card_num);
+	sprintf(pathname, DRM_DEV_NAME, DRM_DIR_NAME, card_num);
 
-	state->fd = open(pathname, O_RDWR | O_CLOEXEC);
-	if (state->fd < 0) {
+	card->fd = open(pathname, O_RDWR | O_CLOEXEC);
+	if (card->fd < 0) {
 		/* TODO check if access permissions, normally root or
 		        membership of the video group is required. */
 		perror("open");
@@ -103,138 +351,262 @@ drm_start(drm_state_t *state)
 		return -1;
 	}
 
+	/* Use atomic modesetting for gamma updates when available. */
+	int atomic = drmSetClientCap(card->fd, DRM_CLIENT_CAP_ATOMIC, 1) == 0;
+
 	/* Acquire mode resources. */
-	state->res = drmModeGetResources(state->fd);
-	if (state->res == NULL) {
-		fprintf(stderr, _("Failed to get DRM mode resources\n"));
-		close(state->fd);
-		state->fd = -1;
+	card->res = drmModeGetResources(card->fd);
+	if (card->res == NULL) {
+		if (!quiet) {
+			fprintf(stderr, _("Failed to get DRM mode resources\n"));
+		}
+		drm_card_free(card);
 		return -1;
 	}
 
 	/* Create entries for selected CRTCs. */
-	int crtc_count = state->res->count_crtcs;
+	int crtc_count = card->res->count_crtcs;
+	int first = 0;
 	if (state->crtc_num >= 0) {
 		if (state->crtc_num >= crtc_count) {
-			fprintf(stderr, _("CRTC %d does not exist. "),
-				state->crtc_num);
-			if (crtc_count > 1) {
-				fprintf(stderr, _("Valid CRTCs are [0-%d].\n"),
-					crtc_count-1);
-			} else {
-				fprintf(stderr, _("Only CRTC 0 exists.\n"));
+			if (!quiet) {
+				fprintf(stderr, _("CRTC %d does not exist. "),
+					state->crtc_num);
+				if (crtc_count > 1) {
+					fprintf(stderr, _("Valid CRTCs are [0-%d].\n"),
+						crtc_count-1);
+				} else {
+					fprintf(stderr, _("Only CRTC 0 exists.\n"));
+				}
 			}
-			close(state->fd);
-			state->fd = -1;
-			drmModeFreeResources(state->res);
-			state->res = NULL;
+			drm_card_free(card);
 			return -1;
 		}
+		first = state->crtc_num;
+		crtc_count = 1;
+	}
 
-		state->crtcs = malloc(2 * sizeof(drm_crtc_state_t));
-		state->crtcs[1].crtc_num = -1;
-
-		state->crtcs->crtc_num = state->crtc_num;
-		state->crtcs->crtc_id = -1;
-		state->crtcs->gamma_size = -1;
-		state->crtcs->r_gamma = NULL;
-		state->crtcs->g_gamma = NULL;
-		state->crtcs->b_gamma = NULL;
-	} else {
-		int crtc_num;
-		state->crtcs = malloc((crtc_count + 1) * sizeof(drm_crtc_state_t));
-		state->crtcs[crtc_count].crtc_num = -1;
-		for (crtc_num = 0; crtc_num < crtc_count; crtc_num++) {
-			state->crtcs[crtc_num].crtc_num = crtc_num;
-			state->crtcs[crtc_num].crtc_id = -1;
-			state->crtcs[crtc_num].gamma_size = -1;
-			state->crtcs[crtc_num].r_gamma = NULL;
-			state->crtcs[crtc_num].g_gamma = NULL;
-			state->crtcs[crtc_num].b_gamma = NULL;
-		}
+	card->crtcs = calloc(crtc_count + 1, sizeof(drm_crtc_state_t));
+	if (card->crtcs == NULL) {
+		perror("malloc");
+		drm_card_free(card);
+		return -1;
+	}
+	card->crtcs[crtc_count].crtc_num = -1;
+	for (int i = 0; i < crtc_count; i++) {
+		card->crtcs[i].crtc_num = first + i;
+		card->crtcs[i].crtc_id = -1;
+		card->crtcs[i].gamma_size = -1;
 	}
 
 	/* Load CRTC information and gamma ramps. */
-	drm_crtc_state_t *crtcs = state->crtcs;
+	drm_crtc_state_t *crtcs = card->crtcs;
 	for (; crtcs->crtc_num >= 0; crtcs++) {
-		crtcs->crtc_id = state->res->crtcs[crtcs->crtc_num];
-		drmModeCrtc* crtc_info = drmModeGetCrtc(state->fd, crtcs->crtc_id);
+		crtcs->crtc_id = card->res->crtcs[crtcs->crtc_num];
+		drmModeCrtc* crtc_info = drmModeGetCrtc(card->fd, crtcs->crtc_id);
 		if (crtc_info == NULL) {
 			fprintf(stderr, _("CRTC %i lost, skipping\n"), crtcs->crtc_num);
 			continue;
 		}
 		crtcs->gamma_size = crtc_info->gamma_size;
+		crtcs->active = crtc_info->mode_valid;
+		crtcs->refresh = crtc_info->mode.vrefresh;
 		drmModeFreeCrtc(crtc_info);
 		if (crtcs->gamma_size <= 1) {
 			fprintf(stderr, _("Could not get gamma ramp size for CRTC %i\n"
 					  "on graphics card %i, ignoring device.\n"),
-				crtcs->crtc_num, state->card_num);
+				crtcs->crtc_num, card_num);
 			continue;
 		}
+		if (atomic) drm_get_color_props(state, card, crtcs);
+		if (state->mode == GAMMA_DRM_MODE_CTM &&
+		    crtcs->ctm_prop == 0) {
+			fprintf(stderr, _("CTM is not supported on CRTC %i"
+					  " of graphics card %i.\n"),
+				crtcs->crtc_num, card_num);
+			drm_card_free(card);
+			return -1;
+		}
+		if (!state->save_ramps) continue;
+
 		/* Valgrind complains about us reading uninitialize memory if we just use malloc. */
 		crtcs->r_gamma = calloc(3 * crtcs->gamma_size, sizeof(uint16_t));
 		crtcs->g_gamma = crtcs->r_gamma + crtcs->gamma_size;
 		crtcs->b_gamma = crtcs->g_gamma + crtcs->gamma_size;
 		if (crtcs->r_gamma != NULL) {
-			int r = drmModeCrtcGetGamma(state->fd, crtcs->crtc_id, crtcs->gamma_size,
+			int r = drmModeCrtcGetGamma(card->fd, crtcs->crtc_id, crtcs->gamma_size,
 						    crtcs->r_gamma, crtcs->g_gamma, crtcs->b_gamma);
 			if (r < 0) {
 				fprintf(stderr, _("DRM could not read gamma ramps on CRTC %i on\n"
 						  "graphics card %i, ignoring device.\n"),
-					crtcs->crtc_num, state->card_num);
+					crtcs->crtc_num, card_num);
 				free(crtcs->r_gamma);
 				crtcs->r_gamma = NULL;
+			} else {
+				colorramp_base_init(&crtcs->base,
+						    crtcs->r_gamma,
+						    crtcs->gamma_size);
 			}
 		} else {
 			perror("malloc");
-			drmModeFreeResources(state->res);
-			state->res = NULL;
-			close(state->fd);
-			state->fd = -1;
-			while (crtcs-- != state->crtcs)
-				free(crtcs->r_gamma);
-			free(state->crtcs);
-			state->crtcs = NULL;
+			drm_card_free(card);
 			return -1;
 		}
 	}
 
+	/* Allocate buffer for new gamma ramps so that updates
+	   do not need to allocate. */
+	int r = drm_alloc_buffers(state, card);
+	if (r < 0) {
+		drm_card_free(card);
+		return -1;
+	}
+
+	drm_card_state_t *cards = realloc(
+		state->cards, (state->card_count + 1) * sizeof(drm_card_state_t));
+	if (cards == NULL) {
+		perror("malloc");
+		drm_card_free(card);
+		return -1;
+	}
+	state->cards = cards;
+	state->cards[state->card_count] = *card;
+	state->card_count += 1;
+
+	if (state->vblank) drm_watch_fd(state, card->fd);
+
+	return 0;
+}
+
+/* Return the state of card number, or NULL if it is not open. */
+static drm_card_state_t *
+drm_find_card(drm_state_t *state, int card_num)
+{
+	for (int i = 0; i < state->card_count; i++) {
+		if (state->cards[i].card_num == card_num) {
+			return &state->cards[i];
+		}
+	}
+
+	return NULL;
+}
+
+static int
+drm_start(drm_state_t *state, int save_ramps)
+{
+	state->save_ramps = save_ramps;
+
+	if (state->card_num >= 0) {
+		return drm_card_open(state, state->card_num, 0);
+	}
+
+	/* Open every card that has CRTCs. */
+	DIR *dir = opendir(DRM_DIR_NAME);
+	if (dir == NULL) {
+		perror("opendir");
+		fprintf(stderr, _("Failed to open DRM device: %s\n"),
+			DRM_DIR_NAME);
+		return -1;
+	}
+
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		int card_num = drm_parse_card_name(entry->d_name);
+		if (card_num < 0) continue;
+
+		drm_card_open(state, card_num, 1);
+	}
+	closedir(dir);
+
+	if (state->card_count == 0) {
+		fputs(_("No graphics card with CRTCs was found.\n"), stderr);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Remove the CTM from every CRTC of card that one has been committed
+   to. Return -1 if the commit failed, in which case the CRTCs stay
+   marked so that the removal is tried again. */
+static int
+drm_card_remove_ctm(drm_card_state_t *card)
+{
+	drmModeAtomicReq *req = NULL;
+	drm_crtc_state_t *crtcs = card->crtcs;
+	for (; crtcs->crtc_num >= 0; crtcs++) {
+		if (crtcs->ctm_committed_prop == 0) continue;
+		if (req == NULL) req = drmModeAtomicAlloc();
+		if (req == NULL) return -1;
+		int r = drmModeAtomicAddProperty(
+			req, crtcs->crtc_id, crtcs->ctm_committed_prop, 0);
+		if (r < 0) {
+			drmModeAtomicFree(req);
+			return -1;
+		}
+	}
+	if (req == NULL) return 0;
+
+	int r = drmModeAtomicCommit(card->fd, req, 0, NULL);
+	drmModeAtomicFree(req);
+	if (r < 0) return -1;
+
+	for (crtcs = card->crtcs; crtcs->crtc_num >= 0; crtcs++) {
+		crtcs->ctm_committed_prop = 0;
+		crtcs->ctm_applied = 0;
+	}
+
 	return 0;
 }
 
 static void
-drm_restore(drm_state_t *state)
+drm_card_restore(drm_card_state_t *card)
 {
-	drm_crtc_state_t *crtcs = state->crtcs;
+	/* Remove the color transformation matrix */
+	drm_card_remove_ctm(card);
+
+	drm_crtc_state_t *crtcs = card->crtcs;
 	while (crtcs->crtc_num >= 0) {
+		crtcs->applied.ramp_size = 0;
 		if (crtcs->r_gamma != NULL) {
-			drmModeCrtcSetGamma(state->fd, crtcs->crtc_id, crtcs->gamma_size,
+			drmModeCrtcSetGamma(card->fd, crtcs->crtc_id, crtcs->gamma_size,
 					    crtcs->r_gamma, crtcs->g_gamma, crtcs->b_gamma);
 		}
 		crtcs++;
 	}
 }
 
+static void
+drm_restore(drm_state_t *state)
+{
+	for (int i = 0; i < state->card_count; i++) {
+		drm_card_restore(&state->cards[i]);
+	}
+}
+
 static void
 drm_free(drm_state_t *state)
 {
-	if (state->crtcs != NULL) {
-		drm_crtc_state_t *crtcs = state->crtcs;
-		while (crtcs->crtc_num >= 0) {
-			free(crtcs->r_gamma);
-			crtcs->crtc_num = -1;
-			crtcs++;
-		}
-		free(state->crtcs);
-		state->crtcs = NULL;
+	for (int i = 0; i < state->card_count; i++) {
+		drm_card_free(&state->cards[i]);
+	}
+	free(state->cards);
+	state->cards = NULL;
+	free(state->ramps);
+	state->ramps = NULL;
+	free(state->lut);
+	state->lut = NULL;
+	if (state->uevent_fd >= 0) {
+		close(state->uevent_fd);
+		state->uevent_fd = -1;
 	}
-	if (state->res != NULL) {
-		drmModeFreeResources(state->res);
-		state->res = NULL;
+	if (state->poll_fd >= 0) {
+		close(state->poll_fd);
+		state->poll_fd = -1;
 	}
-	if (state->fd >= 0) {
-		close(state->fd);
-		state->fd = -1;
+	if (state->recheck_fd >= 0) {
+		close(state->recheck_fd);
+		state->recheck_fd = -1;
 	}
 
 	free(state);
@@ -248,8 +620,13 @@ drm_print_help(FILE *f)
 
 	/* TRANSLATORS: DRM help output
 	   left column must not be translated */
-	fputs(_("  card=N\tGraphics card to apply adjustments to\n"
-		"  crtc=N\tCRTC to apply adjustments to\n"), f);
+	fputs(_("  card=N\tGraphics card to apply adjustments to"
+		" (default: all)\n"
+		"  crtc=N\tCRTC to apply adjustments to\n"
+		"  mode=M\tApply color temperature with `lut',"
+		" `ctm' or `auto'\n"
+		"  vblank=B\tShow fade frames at vertical blank"
+		" (0 or 1)\n"), f);
 	fputs("\n", f);
 }
 
@@ -258,12 +635,30 @@ drm_set_option(drm_state_t *state, const char *key, const char *value)
 {
 	if (strcasecmp(key, "card") == 0) {
 		state->card_num = atoi(value);
+		if (state->card_num < 0) {
+			fprintf(stderr, _("Card must be a non-negative integer\n"));
+			return -1;
+		}
 	} else if (strcasecmp(key, "crtc") == 0) {
 		state->crtc_num = atoi(value);
 		if (state->crtc_num < 0) {
 			fprintf(stderr, _("CRTC must be a non-negative integer\n"));
 			return -1;
 		}
+	} else if (strcasecmp(key, "mode") == 0) {
+		if (strcasecmp(value, "auto") == 0) {
+			state->mode = GAMMA_DRM_MODE_AUTO;
+		} else if (strcasecmp(value, "lut") == 0) {
+			state->mode = GAMMA_DRM_MODE_LUT;
+		} else if (strcasecmp(value, "ctm") == 0) {
+			state->mode = GAMMA_DRM_MODE_CTM;
+		} else {
+			fprintf(stderr, _("Unknown DRM mode: `%s'.\n"),
+				value);
+			return -1;
+		}
+	} else if (strcasecmp(key, "vblank") == 0) {
+		state->vblank = atoi(value) != 0;
 	} else {
 		fprintf(stderr, _("Unknown method parameter: `%s'.\n"), key);
 		return -1;
@@ -272,52 +667,680 @@ drm_set_option(drm_state_t *state, const char *key, const char *value)
 	return 0;
 }
 
+/* Check whether disabled CRTC has been enabled since it was last
+   checked. */
 static int
-drm_set_temperature(
-	drm_state_t *state, const color_setting_t *setting, int preserve)
+drm_crtc_is_active(drm_card_state_t *card, drm_crtc_state_t *crtc)
+{
+	if (!crtc->active) {
+		drmModeCrtc *crtc_info = drmModeGetCrtc(card->fd,
+							crtc->crtc_id);
+		if (crtc_info != NULL) {
+			crtc->active = crtc_info->mode_valid;
+			crtc->refresh = crtc_info->mode.vrefresh;
+			drmModeFreeCrtc(crtc_info);
+		}
+	}
+
+	return crtc->active;
+}
+
+/* Read whether the CRTCs of card have a valid mode. Only disabled
+   CRTCs are read unless all is set. CRTCs that were enabled or
+   disabled are written again when they are active. Return 1 if a CRTC
+   was enabled. */
+static int
+drm_card_check_active(drm_card_state_t *card, int all)
+{
+	int enabled = 0;
+	for (drm_crtc_state_t *crtcs = card->crtcs;
+	     crtcs->crtc_num >= 0; crtcs++) {
+		if (crtcs->gamma_size <= 1) continue;
+		if (crtcs->active && !all) continue;
+
+		drmModeCrtc *crtc_info = drmModeGetCrtc(card->fd,
+							crtcs->crtc_id);
+		if (crtc_info == NULL) continue;
+		int active = crtc_info->mode_valid;
+		crtcs->refresh = crtc_info->mode.vrefresh;
+		drmModeFreeCrtc(crtc_info);
+
+		if (active != crtcs->active) {
+			crtcs->active = active;
+			crtcs->applied.ramp_size = 0;
+			crtcs->ctm_applied = 0;
+			if (active) enabled = 1;
+		}
+	}
+
+	return enabled;
+}
+
+/* Fill ramps of size for CRTC. With preserve the setting is applied
+   on top of the ramps that were saved at start. */
+static void
+drm_fill_ramps(drm_crtc_state_t *crtc, uint16_t *r_gamma,
+	       uint16_t *g_gamma, uint16_t *b_gamma, int size,
+	       const color_setting_t *setting, int preserve)
+{
+	if (preserve && crtc->r_gamma != NULL) {
+		colorramp_fill_base(r_gamma, g_gamma, b_gamma, size,
+				    setting, &crtc->base);
+	} else {
+		/* Create gamma ramps from pure state */
+		colorramp_cache_fill(r_gamma, g_gamma, b_gamma,
+				     size, setting, NULL);
+	}
+}
+
+/* Add update of the GAMMA_LUT of CRTC from ramps to atomic request.
+   Return -1 on error. */
+static int
+drm_add_gamma_lut(drm_state_t *state, drm_card_state_t *card,
+		  drmModeAtomicReq *req, drm_crtc_state_t *crtc,
+		  const uint16_t *r_gamma, const uint16_t *g_gamma,
+		  const uint16_t *b_gamma)
+{
+	for (int i = 0; i < crtc->lut_size; i++) {
+		state->lut[i].red = r_gamma[i];
+		state->lut[i].green = g_gamma[i];
+		state->lut[i].blue = b_gamma[i];
+		state->lut[i].reserved = 0;
+	}
+
+	int r = drmModeCreatePropertyBlob(
+		card->fd, state->lut,
+		crtc->lut_size * sizeof(struct drm_color_lut),
+		&crtc->blob_id);
+	if (r < 0) {
+		crtc->blob_id = 0;
+		return -1;
+	}
+
+	r = drmModeAtomicAddProperty(req, crtc->crtc_id,
+				     crtc->gamma_lut_prop, crtc->blob_id);
+	if (r < 0) return -1;
+
+	return 0;
+}
+
+/* Convert value to the S31.32 sign-magnitude format of the CTM. */
+static uint64_t
+drm_ctm_value(double value)
+{
+	uint64_t sign = 0;
+	if (value < 0.0) {
+		sign = (uint64_t)1 << 63;
+		value = -value;
+	}
+
+	return sign | (uint64_t)(value*((uint64_t)1 << 32) + 0.5);
+}
+
+/* Add update of CRTC for setting in CTM mode to atomic request. The
+   white point and brightness are applied with the CTM while the gamma
+   LUT only applies the gamma exponent, so only the CTM changes with
+   the color temperature. Return -1 on error. */
+static int
+drm_add_ctm(drm_state_t *state, drm_card_state_t *card,
+	    drmModeAtomicReq *req, drm_crtc_state_t *crtc,
+	    const color_setting_t *setting, int preserve)
+{
+	int r;
+
+	color_setting_t lut_setting = *setting;
+	lut_setting.temperature = NEUTRAL_TEMP;
+	lut_setting.brightness = 1.0;
+
+	const uint16_t *source = preserve ? crtc->r_gamma : NULL;
+	if (!colorramp_cache_applied(&crtc->applied, crtc->lut_size,
+				     &lut_setting, source)) {
+		uint16_t *r_gamma = state->ramps;
+		uint16_t *g_gamma = r_gamma + crtc->lut_size;
+		uint16_t *b_gamma = g_gamma + crtc->lut_size;
+
+		drm_fill_ramps(crtc, r_gamma, g_gamma, b_gamma,
+			       crtc->lut_size, &lut_setting, preserve);
+		r = drm_add_gamma_lut(state, card, req, crtc,
+				      r_gamma, g_gamma, b_gamma);
+		if (r < 0) return -1;
+	}
+
+	float white_point[3];
+	colorramp_get_white_point(setting, white_point);
+
+	struct drm_color_ctm ctm;
+	memset(&ctm, 0, sizeof(ctm));
+	for (int i = 0; i < 3; i++) {
+		ctm.matrix[4*i] = drm_ctm_value(
+			white_point[i]*setting->brightness);
+	}
+
+	/* Skip update if the CRTC already has this matrix */
+	if (crtc->ctm_applied &&
+	    memcmp(&ctm, &crtc->ctm, sizeof(ctm)) == 0) {
+		return 0;
+	}
+
+	r = drmModeCreatePropertyBlob(card->fd, &ctm, sizeof(ctm),
+				      &crtc->ctm_blob_id);
+	if (r < 0) {
+		crtc->ctm_blob_id = 0;
+		return -1;
+	}
+
+	r = drmModeAtomicAddProperty(req, crtc->crtc_id, crtc->ctm_prop,
+				     crtc->ctm_blob_id);
+	if (r < 0) return -1;
+
+	crtc->ctm = ctm;
+	crtc->ctm_applied = 1;
+
+	return 0;
+}
+
+/* Stop using atomic updates on card after a failure. A CTM that was
+   committed is removed first, since the legacy ramps apply the white
+   point and brightness as well. */
+static void
+drm_disable_atomic(drm_card_state_t *card)
+{
+	int r = drm_card_remove_ctm(card);
+	if (r < 0) {
+		fprintf(stderr, _("Unable to remove color transformation"
+				  " matrix on graphics card %i.\n"),
+			card->card_num);
+	}
+
+	for (drm_crtc_state_t *crtcs = card->crtcs;
+	     crtcs->crtc_num >= 0; crtcs++) {
+		if (crtcs->lut_size > 0) {
+			crtcs->gamma_lut_prop = 0;
+			crtcs->lut_size = 0;
+			crtcs->ctm_prop = 0;
+			crtcs->ctm_applied = 0;
+			crtcs->applied.ramp_size = 0;
+		}
+	}
+}
+
+static void
+drm_vblank_handler(int fd, unsigned int sequence, unsigned int tv_sec,
+		   unsigned int tv_usec, void *user_data)
+{
+}
+
+/* Read the requested vblank event of card if it has arrived. */
+static void
+drm_card_read_events(drm_card_state_t *card)
 {
-	drm_crtc_state_t *crtcs = state->crtcs;
-	int last_gamma_size = 0;
-	uint16_t *r_gamma = NULL;
-	uint16_t *g_gamma = NULL;
-	uint16_t *b_gamma = NULL;
+	if (!card->vblank_pending) return;
+
+	struct pollfd pollfd = { card->fd, POLLIN, 0 };
+	if (poll(&pollfd, 1, 0) <= 0) return;
+
+	drmEventContext context;
+	memset(&context, 0, sizeof(context));
+	context.version = 2;
+	context.vblank_handler = drm_vblank_handler;
+	drmHandleEvent(card->fd, &context);
+
+	card->vblank_pending = 0;
+}
+
+/* Request event on the vblank of CRTC that the next fade frame is due
+   at, assuming frames are interval seconds apart. The main loop wakes
+   up on the event, so the frame is written at the start of a vertical
+   blank rather than at an arbitrary point of the scanout. The last
+   vblank before the frame is due is used, since the main loop shows a
+   frame when it wakes up slightly early. */
+static void
+drm_card_request_vblank(drm_card_state_t *card, drm_crtc_state_t *crtc,
+			double interval)
+{
+	int frames = interval*crtc->refresh + 0.01;
+	if (frames < 1) frames = 1;
+
+	drmVBlank vbl;
+	memset(&vbl, 0, sizeof(vbl));
+	vbl.request.type = DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT;
+	if (crtc->crtc_num == 1) {
+		vbl.request.type |= DRM_VBLANK_SECONDARY;
+	} else if (crtc->crtc_num > 1) {
+		vbl.request.type |= (crtc->crtc_num <<
+				     DRM_VBLANK_HIGH_CRTC_SHIFT) &
+			DRM_VBLANK_HIGH_CRTC_MASK;
+	}
+	vbl.request.sequence = frames;
+	vbl.request.signal = 0;
+
+	int r = drmWaitVBlank(card->fd, &vbl);
+	if (r == 0) card->vblank_pending = 1;
+}
+
+static void
+drm_card_set_temperature(drm_state_t *state, drm_card_state_t *card,
+			 const color_setting_t *setting, int preserve)
+{
+	drm_crtc_state_t *crtcs = card->crtcs;
+
+	/* CRTC that was updated, to pace the next update by */
+	drm_crtc_state_t *updated = NULL;
+	drm_card_read_events(card);
+
+	/* CRTCs with a GAMMA_LUT are all updated in a single
+	   atomic commit. */
+	drmModeAtomicReq *req = NULL;
+	int atomic_failed = 0;
 
 	for (; crtcs->crtc_num >= 0; crtcs++) {
 		if (crtcs->gamma_size <= 1)
 			continue;
-		if (crtcs->gamma_size != last_gamma_size) {
-			if (last_gamma_size == 0) {
-				r_gamma = malloc(3 * crtcs->gamma_size * sizeof(uint16_t));
-				g_gamma = r_gamma + crtcs->gamma_size;
-				b_gamma = g_gamma + crtcs->gamma_size;
-			} else if (crtcs->gamma_size > last_gamma_size) {
-				r_gamma = realloc(r_gamma, 3 * crtcs->gamma_size * sizeof(uint16_t));
-				g_gamma = r_gamma + crtcs->gamma_size;
-				b_gamma = g_gamma + crtcs->gamma_size;
+
+		if (crtcs->ctm_prop != 0) {
+			/* Skip disabled CRTC */
+			if (!drm_crtc_is_active(card, crtcs)) {
+				crtcs->applied.ramp_size = 0;
+				crtcs->ctm_applied = 0;
+				continue;
+			}
+
+			if (req == NULL) req = drmModeAtomicAlloc();
+			int r = -1;
+			if (req != NULL) {
+				r = drm_add_ctm(state, card, req, crtcs,
+						setting, preserve);
+			}
+			if (r < 0) {
+				atomic_failed = 1;
+				break;
+			}
+			if (updated == NULL &&
+			    (crtcs->blob_id != 0 || crtcs->ctm_blob_id != 0)) {
+				updated = crtcs;
 			}
-			if (r_gamma == NULL) {
-				perror(last_gamma_size == 0 ? "malloc" : "realloc");
-				return -1;
+			continue;
+		}
+
+		int size = crtcs->lut_size > 0 ?
+			crtcs->lut_size : crtcs->gamma_size;
+
+		/* Skip update if the CRTC already shows these ramps */
+		const uint16_t *source = preserve ? crtcs->r_gamma : NULL;
+		if (colorramp_cache_applied(&crtcs->applied, size,
+					    setting, source))
+			continue;
+
+		/* Skip disabled CRTC. It is checked again when the
+		   main loop wakes up. */
+		if (!drm_crtc_is_active(card, crtcs)) {
+			crtcs->applied.ramp_size = 0;
+			continue;
+		}
+
+		uint16_t *r_gamma = state->ramps;
+		uint16_t *g_gamma = r_gamma + size;
+		uint16_t *b_gamma = g_gamma + size;
+
+		drm_fill_ramps(crtcs, r_gamma, g_gamma, b_gamma, size,
+			       setting, preserve);
+
+		if (crtcs->lut_size > 0) {
+			if (req == NULL) req = drmModeAtomicAlloc();
+			int r = -1;
+			if (req != NULL) {
+				r = drm_add_gamma_lut(state, card, req, crtcs,
+						      r_gamma, g_gamma,
+						      b_gamma);
+			}
+			if (r < 0) {
+				atomic_failed = 1;
+				break;
+			}
+			if (updated == NULL) updated = crtcs;
+			continue;
+		}
+
+		int r = drmModeCrtcSetGamma(card->fd, crtcs->crtc_id,
+					    crtcs->gamma_size,
+					    r_gamma, g_gamma, b_gamma);
+		if (r < 0) {
+			/* The CRTC may have been disabled */
+			crtcs->applied.ramp_size = 0;
+			crtcs->active = 0;
+		} else if (updated == NULL) {
+			updated = crtcs;
+		}
+	}
+
+	if (req != NULL) {
+		if (!atomic_failed) {
+			int r = drmModeAtomicCommit(card->fd, req, 0, NULL);
+			if (r < 0) atomic_failed = 1;
+		}
+		drmModeAtomicFree(req);
+	}
+
+	/* Remember where a CTM is set, so that it can be removed */
+	if (!atomic_failed) {
+		for (crtcs = card->crtcs; crtcs->crtc_num >= 0; crtcs++) {
+			if (crtcs->ctm_blob_id != 0) {
+				crtcs->ctm_committed_prop = crtcs->ctm_prop;
 			}
-			last_gamma_size = crtcs->gamma_size;
 		}
+	}
 
-		/* Initialize gamma ramps to pure state */
-		int ramp_size = crtcs->gamma_size;
-		for (int i = 0; i < ramp_size; i++) {
-			uint16_t value = (double)i/ramp_size * (UINT16_MAX+1);
-			r_gamma[i] = value;
-			g_gamma[i] = value;
-			b_gamma[i] = value;
+	/* The CRTC state holds a reference to the blobs
+	   that were committed. */
+	for (crtcs = card->crtcs; crtcs->crtc_num >= 0; crtcs++) {
+		if (crtcs->blob_id != 0) {
+			drmModeDestroyPropertyBlob(card->fd, crtcs->blob_id);
+			crtcs->blob_id = 0;
+		}
+		if (crtcs->ctm_blob_id != 0) {
+			drmModeDestroyPropertyBlob(card->fd,
+						   crtcs->ctm_blob_id);
+			crtcs->ctm_blob_id = 0;
 		}
+	}
 
-		colorramp_fill(r_gamma, g_gamma, b_gamma, crtcs->gamma_size,
-			       setting);
-		drmModeCrtcSetGamma(state->fd, crtcs->crtc_id, crtcs->gamma_size,
-				    r_gamma, g_gamma, b_gamma);
+	if (atomic_failed) {
+		fprintf(stderr, _("Atomic gamma update failed on graphics"
+				  " card %i, falling back to legacy gamma"
+				  " ramps.\n"), card->card_num);
+		drm_disable_atomic(card);
+		drm_card_set_temperature(state, card, setting, preserve);
+		return;
 	}
 
-	free(r_gamma);
+	/* The interval of the next fade frame is taken to be the
+	   interval since the previous update. */
+	double now;
+	if (state->vblank && updated != NULL &&
+	    systemtime_get_monotonic(&now) == 0) {
+		double interval = now - card->last_update;
+		card->last_update = now;
+		if (interval <= DRM_VBLANK_MAX_INTERVAL &&
+		    !card->vblank_pending) {
+			drm_card_request_vblank(card, updated, interval);
+		}
+	}
+}
+
+static int
+drm_set_temperature(
+	drm_state_t *state, const color_setting_t *setting, int preserve)
+{
+	for (int i = 0; i < state->card_count; i++) {
+		drm_card_set_temperature(state, &state->cards[i],
+					 setting, preserve);
+	}
+
+	return 0;
+}
+
+/* Open socket for device events that have been processed by udev, so
+   the device nodes exist when the event is received. */
+static int
+drm_open_uevent_socket()
+{
+#ifdef __linux__
+	int fd = socket(AF_NETLINK,
+			SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+			NETLINK_KOBJECT_UEVENT);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	struct sockaddr_nl addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = UDEV_MONITOR_GROUP;
+
+	int r = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+	if (r < 0) {
+		perror("bind");
+		close(fd);
+		return -1;
+	}
+
+	/* Credentials are needed to check the sender. */
+	int on = 1;
+	r = setsockopt(fd, SOL_SOCKET, SO_PASSCRED, &on, sizeof(on));
+	if (r < 0) {
+		perror("setsockopt");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+#else
+	return -1;
+#endif
+}
+
+/* Receive next device event from socket. Return 1 if an event was
+   received, 0 if there are no more messages and -1 on error. Messages
+   that were not sent by root are skipped. */
+static int
+drm_receive_uevent(int fd, drm_uevent_t *event)
+{
+#ifdef __linux__
+	char buf[UEVENT_BUFFER_SIZE];
+	char control[CMSG_SPACE(sizeof(struct ucred))];
+
+	while (1) {
+		struct iovec iov = { buf, sizeof(buf) - 1 };
+		struct sockaddr_nl addr;
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_name = &addr;
+		msg.msg_namelen = sizeof(addr);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		ssize_t len = recvmsg(fd, &msg, 0);
+		if (len < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return 0;
+			} else if (errno == EINTR || errno == ENOBUFS) {
+				/* Events were lost if the buffer
+				   overflowed; keep going. */
+				continue;
+			}
+			perror("recvmsg");
+			return -1;
+		}
+		buf[len] = '\0';
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		if (cmsg == NULL || cmsg->cmsg_type != SCM_CREDENTIALS) {
+			continue;
+		}
+		struct ucred cred;
+		memcpy(&cred, CMSG_DATA(cmsg), sizeof(cred));
+		if (cred.uid != 0) continue;
+
+		if (drm_parse_uevent(buf, len, event) > 0) return 1;
+	}
+#else
+	return 0;
+#endif
+}
+
+static int
+drm_get_fd(drm_state_t *state)
+{
+	/* The socket is only needed when redshift keeps running, so it
+	   is opened when the main loop asks for it. */
+	if (state->uevent_fd == -2) {
+		state->uevent_fd = drm_open_uevent_socket();
+		if (state->uevent_fd < 0) {
+			fputs(_("Unable to watch for graphics card"
+				" changes.\n"), stderr);
+		}
+
+#ifdef __linux__
+		/* The main loop waits for a set of the socket, the
+		   timer of CRTC checks after connectors changed and,
+		   since vblank events arrive on them, the cards. */
+		state->poll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (state->poll_fd < 0) {
+			perror("epoll_create1");
+		} else {
+			state->recheck_fd = timerfd_create(
+				CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+			if (state->recheck_fd < 0) perror("timerfd_create");
+			drm_watch_fd(state, state->uevent_fd);
+			drm_watch_fd(state, state->recheck_fd);
+			for (int i = 0; state->vblank &&
+				     i < state->card_count; i++) {
+				drm_watch_fd(state, state->cards[i].fd);
+			}
+		}
+#endif
+	}
+
+	if (state->poll_fd >= 0) return state->poll_fd;
+#ifndef __linux__
+	if (state->vblank && state->card_count > 0) {
+		return state->cards[0].fd;
+	}
+#endif
+
+	return state->uevent_fd;
+}
+
+/* Check CRTCs a number of times after connectors changed. */
+static void
+drm_start_rechecks(drm_state_t *state)
+{
+#ifdef __linux__
+	if (state->recheck_fd < 0) return;
+
+	struct itimerspec spec;
+	spec.it_interval.tv_sec = 0;
+	spec.it_interval.tv_nsec = DRM_RECHECK_INTERVAL*1000000000;
+	spec.it_value = spec.it_interval;
+	int r = timerfd_settime(state->recheck_fd, 0, &spec, NULL);
+	if (r < 0) {
+		perror("timerfd_settime");
+		return;
+	}
+
+	state->rechecks = DRM_RECHECK_COUNT;
+#endif
+}
+
+/* Return 1 if the CRTCs are due to be checked after connectors
+   changed. */
+static int
+drm_rechecks_due(drm_state_t *state)
+{
+#ifdef __linux__
+	if (state->recheck_fd < 0 || state->rechecks == 0) return 0;
+
+	uint64_t expirations;
+	ssize_t r = read(state->recheck_fd, &expirations,
+			 sizeof(expirations));
+	if (r != sizeof(expirations)) return 0;
+
+	if (expirations >= state->rechecks) {
+		/* Stop timer */
+		struct itimerspec spec;
+		memset(&spec, 0, sizeof(spec));
+		timerfd_settime(state->recheck_fd, 0, &spec, NULL);
+		state->rechecks = 0;
+	} else {
+		state->rechecks -= expirations;
+	}
+
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+static int
+drm_handle(
+	drm_state_t *state, const color_setting_t *setting, int preserve)
+{
+	/* Disabled CRTCs are checked on every wake up, and all CRTCs
+	   for a while after connectors changed. */
+	int changed = 0;
+	int recheck = drm_rechecks_due(state);
+	for (int i = 0; i < state->card_count; i++) {
+		drm_card_read_events(&state->cards[i]);
+		if (drm_card_check_active(&state->cards[i], recheck)) {
+			changed = 1;
+		}
+	}
+
+	drm_uevent_t event;
+	while (state->uevent_fd >= 0) {
+		int r = drm_receive_uevent(state->uevent_fd, &event);
+		if (r < 0) return -1;
+		if (r == 0) break;
+
+		/* Only the selected card is followed */
+		if (state->card_num >= 0 &&
+		    event.card_num != state->card_num) {
+			continue;
+		}
+
+		drm_card_state_t *card = drm_find_card(state, event.card_num);
+		if (strcmp(event.action, "add") == 0) {
+			if (card != NULL) continue;
+			r = drm_card_open(state, event.card_num,
+					  state->card_num < 0);
+			if (r == 0) changed = 1;
+		} else if (strcmp(event.action, "remove") == 0) {
+			if (card == NULL) continue;
+			drm_card_free(card);
+			state->card_count -= 1;
+			*card = state->cards[state->card_count];
+		} else if (strcmp(event.action, "change") == 0 &&
+			   event.hotplug) {
+			if (card == NULL) continue;
+			/* Connectors changed, so write the ramps of
+			   every CRTC again and check which CRTCs are
+			   active, now and once the new modes are set. */
+			for (drm_crtc_state_t *crtcs = card->crtcs;
+			     crtcs->crtc_num >= 0; crtcs++) {
+				crtcs->applied.ramp_size = 0;
+				crtcs->ctm_applied = 0;
+			}
+			drm_card_check_active(card, 1);
+			drm_start_rechecks(state);
+			changed = 1;
+		}
+	}
+
+	if (changed) {
+		return drm_set_temperature(state, setting, preserve);
+	}
+
+	return 0;
+}
+
+static int
+drm_get_crtc_count(drm_state_t *state, int *active, int *total)
+{
+	*active = 0;
+	*total = 0;
+	for (int i = 0; i < state->card_count; i++) {
+		drm_card_state_t *card = &state->cards[i];
+		for (drm_crtc_state_t *crtcs = card->crtcs;
+		     crtcs->crtc_num >= 0; crtcs++) {
+			if (crtcs->active && crtcs->gamma_size > 1) {
+				*active += 1;
+			}
+		}
+		*total += card->res->count_crtcs;
+	}
 
 	return 0;
 }
@@ -331,5 +1354,8 @@ const gamma_method_t drm_gamma_method = {
 	(gamma_method_print_help_func *)drm_print_help,
 	(gamma_method_set_option_func *)drm_set_option,
 	(gamma_method_restore_func *)drm_restore,
-	(gamma_method_set_temperature_func *)drm_set_temperature
+	(gamma_method_set_temperature_func *)drm_set_temperature,
+	(gamma_method_get_fd_func *)drm_get_fd,
+	(gamma_method_handle_func *)drm_handle,
+	(gamma_method_get_crtc_count_func *)drm_get_crtc_count
 };
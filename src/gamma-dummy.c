@@ -23,6 +23,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef ENABLE_NLS
 # include <libintl.h>
@@ -32,17 +33,27 @@
 #endif
 
 #include "redshift.h"
+#include "systemtime.h"
+
+
+typedef struct {
+	/* Milliseconds that each adjustment takes */
+	int delay;
+} dummy_state_t;
 
 
 static int
-gamma_dummy_init(void **state)
+gamma_dummy_init(dummy_state_t **state)
 {
-	*state = NULL;
+	*state = malloc(sizeof(dummy_state_t));
+	if (*state == NULL) return -1;
+
+	(*state)->delay = 0;
 	return 0;
 }
 
 static int
-gamma_dummy_start(void *state)
+gamma_dummy_start(void *state, int save_ramps)
 {
 	fputs(_("WARNING: Using dummy gamma method! Display will not be affected by this gamma method.\n"), stderr);
 	return 0;
@@ -54,8 +65,9 @@ gamma_dummy_restore(void *state)
 }
 
 static void
-gamma_dummy_free(void *state)
+gamma_dummy_free(dummy_state_t *state)
 {
+	free(state);
 }
 
 static void
@@ -63,23 +75,63 @@ gamma_dummy_print_help(FILE *f)
 {
 	fputs(_("Does not affect the display but prints the color temperature to the terminal.\n"), f);
 	fputs("\n", f);
+
+	/* TRANSLATORS: dummy help output
+	   left column must not be translated */
+	fputs(_("  delay=N\tMilliseconds that each adjustment takes\n"),
+	      f);
+	fputs("\n", f);
 }
 
 static int
-gamma_dummy_set_option(void *state, const char *key, const char *value)
+gamma_dummy_set_option(
+	dummy_state_t *state, const char *key, const char *value)
 {
-	fprintf(stderr, _("Unknown method parameter: `%s'.\n"), key);
-	return -1;
+	if (strcasecmp(key, "delay") == 0) {
+		state->delay = atoi(value);
+		if (state->delay < 0) {
+			fprintf(stderr, _("Delay must be a non-negative integer\n"));
+			return -1;
+		}
+	} else {
+		fprintf(stderr, _("Unknown method parameter: `%s'.\n"), key);
+		return -1;
+	}
+
+	return 0;
 }
 
 static int
 gamma_dummy_set_temperature(
-	void *state, const color_setting_t *setting, int preserve)
+	dummy_state_t *state, const color_setting_t *setting, int preserve)
 {
+	/* Stand in for a slow display so fades can be tested with
+	   adjustments that take longer than a frame. */
+	if (state->delay > 0) systemtime_msleep(state->delay);
+
 	printf(_("Temperature: %i\n"), setting->temperature);
 	return 0;
 }
 
+static int
+gamma_dummy_get_fd(void *state)
+{
+	return -1;
+}
+
+static int
+gamma_dummy_handle(
+	void *state, const color_setting_t *setting, int preserve)
+{
+	return 0;
+}
+
+static int
+gamma_dummy_get_crtc_count(void *state, int *active, int *total)
+{
+	return -1;
+}
+
 
 const gamma_method_t dummy_gamma_method = {
 	"dummy", 0,
@@ -89,5 +141,8 @@ const gamma_method_t dummy_gamma_method = {
 	(gamma_method_print_help_func *)gamma_dummy_print_help,
 	(gamma_method_set_option_func *)gamma_dummy_set_option,
 	(gamma_method_restore_func *)gamma_dummy_restore,
-	(gamma_method_set_temperature_func *)gamma_dummy_set_temperature
+	(gamma_method_set_temperature_func *)gamma_dummy_set_temperature,
+	(gamma_method_get_fd_func *)gamma_dummy_get_fd,
+	(gamma_method_handle_func *)gamma_dummy_handle,
+	(gamma_method_get_crtc_count_func *)gamma_dummy_get_crtc_count
 };
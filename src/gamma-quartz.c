@@ -41,6 +41,8 @@ typedef struct {
 	CGDirectDisplayID display;
 	uint32_t ramp_size;
 	float *saved_ramps;
+	/* Buffer for new gamma ramps */
+	float *ramps;
 } quartz_display_state_t;
 
 typedef struct {
@@ -62,7 +64,7 @@ quartz_init(quartz_state_t **state)
 }
 
 static int
-quartz_start(quartz_state_t *state)
+quartz_start(quartz_state_t *state, int save_ramps)
 {
 	CGError error;
 	uint32_t display_count;
@@ -101,6 +103,7 @@ quartz_start(quartz_state_t *state)
 	for (int i = 0; i < display_count; i++) {
 		state->displays[i].display = displays[i];
 		state->displays[i].saved_ramps = NULL;
+		state->displays[i].ramps = NULL;
 	}
 
 	free(displays);
@@ -118,6 +121,16 @@ quartz_start(quartz_state_t *state)
 
 		state->displays[i].ramp_size = ramp_size;
 
+		/* Allocate space for new ramps */
+		state->displays[i].ramps =
+			malloc(3 * ramp_size * sizeof(float));
+		if (state->displays[i].ramps == NULL) {
+			perror("malloc");
+			return -1;
+		}
+
+		if (!save_ramps) continue;
+
 		/* Allocate space for saved ramps */
 		state->displays[i].saved_ramps =
 			malloc(3 * ramp_size * sizeof(float));
@@ -158,6 +171,7 @@ quartz_free(quartz_state_t *state)
 	if (state->displays != NULL) {
 		for (int i = 0; i < state->display_count; i++) {
 			free(state->displays[i].saved_ramps);
+			free(state->displays[i].ramps);
 		}
 	}
 	free(state->displays);
@@ -196,42 +210,25 @@ quartz_set_temperature_for_display(
 	uint32_t ramp_size = state->displays[display_index].ramp_size;
 
 	/* Create new gamma ramps */
-	float *gamma_ramps = malloc(3*ramp_size*sizeof(float));
-	if (gamma_ramps == NULL) {
-		perror("malloc");
-		return;
-	}
-
+	float *gamma_ramps = state->displays[display_index].ramps;
 	float *gamma_r = &gamma_ramps[0*ramp_size];
 	float *gamma_g = &gamma_ramps[1*ramp_size];
 	float *gamma_b = &gamma_ramps[2*ramp_size];
 
-	if (preserve) {
+	if (preserve && state->displays[display_index].saved_ramps != NULL) {
 		/* Initialize gamma ramps from saved state */
 		memcpy(gamma_ramps, state->displays[display_index].saved_ramps,
 		       3*ramp_size*sizeof(float));
+		colorramp_fill_float(gamma_r, gamma_g, gamma_b, ramp_size,
+				     setting);
 	} else {
-		/* Initialize gamma ramps to pure state */
-		for (int i = 0; i < ramp_size; i++) {
-			float value = (double)i/ramp_size;
-			gamma_r[i] = value;
-			gamma_g[i] = value;
-			gamma_b[i] = value;
-		}
-	}
-
-	colorramp_fill_float(gamma_r, gamma_g, gamma_b, ramp_size,
-			     setting);
-
-	CGError error =
-		CGSetDisplayTransferByTable(display, ramp_size,
-					    gamma_r, gamma_g, gamma_b);
-	if (error != kCGErrorSuccess) {
-		free(gamma_ramps);
-		return;
+		/* Create gamma ramps from pure state */
+		colorramp_fill_pure_float(gamma_r, gamma_g, gamma_b,
+					  ramp_size, setting);
 	}
 
-	free(gamma_ramps);
+	CGSetDisplayTransferByTable(display, ramp_size,
+				    gamma_r, gamma_g, gamma_b);
 }
 
 static int
@@ -246,6 +243,25 @@ quartz_set_temperature(
 	return 0;
 }
 
+static int
+quartz_get_fd(quartz_state_t *state)
+{
+	return -1;
+}
+
+static int
+quartz_handle(
+	quartz_state_t *state, const color_setting_t *setting, int preserve)
+{
+	return 0;
+}
+
+static int
+quartz_get_crtc_count(quartz_state_t *state, int *active, int *total)
+{
+	return -1;
+}
+
 
 const gamma_method_t quartz_gamma_method = {
 	"quartz", 1,
@@ -255,5 +271,8 @@ const gamma_method_t quartz_gamma_method = {
 	(gamma_method_print_help_func *)quartz_print_help,
 	(gamma_method_set_option_func *)quartz_set_option,
 	(gamma_method_restore_func *)quartz_restore,
-	(gamma_method_set_temperature_func *)quartz_set_temperature
+	(gamma_method_set_temperature_func *)quartz_set_temperature,
+	(gamma_method_get_fd_func *)quartz_get_fd,
+	(gamma_method_handle_func *)quartz_handle,
+	(gamma_method_get_crtc_count_func *)quartz_get_crtc_count
 };
@@ -39,7 +39,7 @@
 
 #include "gamma-randr.h"
 #include "redshift.h"
-#include "colorramp.h"
+#include "colorramp-cache.h"
 
 
 #define RANDR_VERSION_MAJOR  1
@@ -50,6 +50,17 @@ typedef struct {
 	xcb_randr_crtc_t crtc;
 	unsigned int ramp_size;
 	uint16_t *saved_ramps;
+	/* Buffer for new gamma ramps */
+	uint16_t *ramps;
+	/* Key of the ramps last applied to the CRTC */
+	colorramp_key_t applied;
+	/* Set gamma request that has not been checked yet */
+	xcb_void_cookie_t cookie;
+	int pending;
+	/* Size and gamma ramps must be queried */
+	int probe;
+	/* CRTC has a mode and outputs */
+	int active;
 } randr_crtc_state_t;
 
 typedef struct {
@@ -61,6 +72,10 @@ typedef struct {
 	int* crtc_num;
 	unsigned int crtc_count;
 	randr_crtc_state_t *crtcs;
+	/* Event code of the first RandR event */
+	int event_base;
+	/* Current ramps are saved when CRTCs are probed */
+	int save_ramps;
 } randr_state_t;
 
 
@@ -117,32 +132,40 @@ randr_init(randr_state_t **state)
 	return 0;
 }
 
-static int
-randr_start(randr_state_t *state)
+/* Free the saved ramps and buffers of CRTC. */
+static void
+randr_crtc_clear(randr_crtc_state_t *crtc)
 {
-	xcb_generic_error_t *error;
-
-	int screen_num = state->screen_num;
-	if (screen_num < 0) screen_num = state->preferred_screen;
+	colorramp_cache_invalidate(crtc->saved_ramps);
+	free(crtc->saved_ramps);
+	free(crtc->ramps);
+	crtc->saved_ramps = NULL;
+	crtc->ramps = NULL;
+	crtc->ramp_size = 0;
+	crtc->applied.ramp_size = 0;
+	crtc->active = 0;
+}
 
-	/* Get screen */
-	const xcb_setup_t *setup = xcb_get_setup(state->conn);
-	xcb_screen_iterator_t iter = xcb_setup_roots_iterator(setup);
-	state->screen = NULL;
+/* Return whether CRTC index is selected for adjustments. */
+static int
+randr_crtc_is_selected(randr_state_t *state, int crtc_num)
+{
+	if (state->crtc_num_count == 0) return 1;
 
-	for (int i = 0; iter.rem > 0; i++) {
-		if (i == screen_num) {
-			state->screen = iter.data;
-			break;
-		}
-		xcb_screen_next(&iter);
+	for (int i = 0; i < state->crtc_num_count; i++) {
+		if (state->crtc_num[i] == crtc_num) return 1;
 	}
 
-	if (state->screen == NULL) {
-		fprintf(stderr, _("Screen %i could not be found.\n"),
-			screen_num);
-		return -1;
-	}
+	return 0;
+}
+
+/* Update the list of CRTCs from the screen resources. CRTCs that
+   were already known keep their state. Selected CRTCs that have not
+   been probed yet are marked for probing. */
+static int
+randr_update_crtcs(randr_state_t *state)
+{
+	xcb_generic_error_t *error;
 
 	/* Get list of CRTCs for the screen */
 	xcb_randr_get_screen_resources_current_cookie_t res_cookie =
@@ -157,73 +180,217 @@ randr_start(randr_state_t *state)
 		fprintf(stderr, _("`%s' returned error %d\n"),
 			"RANDR Get Screen Resources Current",
 			error->error_code);
+		free(error);
 		return -1;
 	}
 
-	state->crtc_count = res_reply->num_crtcs;
-	state->crtcs = calloc(state->crtc_count, sizeof(randr_crtc_state_t));
-	if (state->crtcs == NULL) {
+	unsigned int crtc_count = res_reply->num_crtcs;
+	randr_crtc_state_t *crtcs =
+		calloc(crtc_count, sizeof(randr_crtc_state_t));
+	if (crtc_count > 0 && crtcs == NULL) {
 		perror("malloc");
-		state->crtc_count = 0;
+		free(res_reply);
 		return -1;
 	}
 
-	xcb_randr_crtc_t *crtcs =
+	xcb_randr_crtc_t *crtc_ids =
 		xcb_randr_get_screen_resources_current_crtcs(res_reply);
 
 	/* Save CRTC identifier in state */
-	for (int i = 0; i < state->crtc_count; i++) {
-		state->crtcs[i].crtc = crtcs[i];
+	for (int i = 0; i < crtc_count; i++) {
+		crtcs[i].crtc = crtc_ids[i];
+
+		for (int j = 0; j < state->crtc_count; j++) {
+			if (state->crtcs[j].crtc == crtc_ids[i]) {
+				crtcs[i] = state->crtcs[j];
+				state->crtcs[j].crtc = XCB_NONE;
+				break;
+			}
+		}
+
+		crtcs[i].probe = crtcs[i].ramp_size == 0 &&
+			randr_crtc_is_selected(state, i);
 	}
 
 	free(res_reply);
 
-	/* Save size and gamma ramps of all CRTCs.
-	   Current gamma ramps are saved so we can restore them
-	   at program exit. */
+	/* Free state of CRTCs that were removed */
 	for (int i = 0; i < state->crtc_count; i++) {
-		xcb_randr_crtc_t crtc = state->crtcs[i].crtc;
+		if (state->crtcs[i].crtc != XCB_NONE) {
+			randr_crtc_clear(&state->crtcs[i]);
+		}
+	}
+	free(state->crtcs);
+
+	state->crtc_count = crtc_count;
+	state->crtcs = crtcs;
 
-		/* Request size of gamma ramps */
-		xcb_randr_get_crtc_gamma_size_cookie_t gamma_size_cookie =
-			xcb_randr_get_crtc_gamma_size(state->conn, crtc);
+	return 0;
+}
+
+/* Query configuration, size and gamma ramps of the CRTCs marked for
+   probing. The current ramps are saved if enabled, unless the CRTC has
+   been probed before with the same ramp size. All requests are sent
+   before any reply is read, so this only takes a single round trip.
+   CRTCs that fail are left without ramps and -1 is returned. */
+static int
+randr_probe_crtcs(randr_state_t *state)
+{
+	xcb_generic_error_t *error;
+	int failed = 0;
+
+	if (state->crtc_count == 0) return 0;
+
+	xcb_randr_get_crtc_gamma_size_cookie_t *gamma_size_cookies =
+		malloc(state->crtc_count*
+		       sizeof(xcb_randr_get_crtc_gamma_size_cookie_t));
+	xcb_randr_get_crtc_gamma_cookie_t *gamma_get_cookies =
+		malloc(state->crtc_count*
+		       sizeof(xcb_randr_get_crtc_gamma_cookie_t));
+	xcb_randr_get_crtc_info_cookie_t *info_cookies =
+		malloc(state->crtc_count*
+		       sizeof(xcb_randr_get_crtc_info_cookie_t));
+	if (gamma_size_cookies == NULL || gamma_get_cookies == NULL ||
+	    info_cookies == NULL) {
+		perror("malloc");
+		free(gamma_size_cookies);
+		free(gamma_get_cookies);
+		free(info_cookies);
+		return -1;
+	}
+
+	for (int i = 0; i < state->crtc_count; i++) {
+		if (!state->crtcs[i].probe) continue;
+		info_cookies[i] =
+			xcb_randr_get_crtc_info(state->conn,
+						state->crtcs[i].crtc,
+						XCB_CURRENT_TIME);
+	}
+
+	for (int i = 0; i < state->crtc_count; i++) {
+		if (!state->crtcs[i].probe) continue;
+		gamma_size_cookies[i] =
+			xcb_randr_get_crtc_gamma_size(state->conn,
+						      state->crtcs[i].crtc);
+	}
+
+	for (int i = 0; i < state->crtc_count; i++) {
+		if (!state->crtcs[i].probe || !state->save_ramps) continue;
+		gamma_get_cookies[i] =
+			xcb_randr_get_crtc_gamma(state->conn,
+						 state->crtcs[i].crtc);
+	}
+
+	for (int i = 0; i < state->crtc_count; i++) {
+		randr_crtc_state_t *crtc = &state->crtcs[i];
+		if (!crtc->probe) continue;
+		crtc->probe = 0;
+
+		/* Receive CRTC configuration */
+		xcb_randr_get_crtc_info_reply_t *info_reply =
+			xcb_randr_get_crtc_info_reply(
+				state->conn, info_cookies[i], &error);
+
+		if (error) {
+			fprintf(stderr, _("`%s' returned error %d\n"),
+				"RANDR Get CRTC Info", error->error_code);
+			free(error);
+			xcb_discard_reply(state->conn,
+					  gamma_size_cookies[i].sequence);
+			if (state->save_ramps) {
+				xcb_discard_reply(
+					state->conn,
+					gamma_get_cookies[i].sequence);
+			}
+			randr_crtc_clear(crtc);
+			failed = 1;
+			continue;
+		}
+
+		int active = info_reply->mode != XCB_NONE &&
+			info_reply->num_outputs > 0;
+		free(info_reply);
+
+		/* Receive size of gamma ramps */
 		xcb_randr_get_crtc_gamma_size_reply_t *gamma_size_reply =
-			xcb_randr_get_crtc_gamma_size_reply(state->conn,
-							    gamma_size_cookie,
-							    &error);
+			xcb_randr_get_crtc_gamma_size_reply(
+				state->conn, gamma_size_cookies[i], &error);
 
 		if (error) {
 			fprintf(stderr, _("`%s' returned error %d\n"),
 				"RANDR Get CRTC Gamma Size",
 				error->error_code);
-			return -1;
+			free(error);
+			if (state->save_ramps) {
+				xcb_discard_reply(
+					state->conn,
+					gamma_get_cookies[i].sequence);
+			}
+			randr_crtc_clear(crtc);
+			failed = 1;
+			continue;
 		}
 
 		unsigned int ramp_size = gamma_size_reply->size;
-		state->crtcs[i].ramp_size = ramp_size;
-
 		free(gamma_size_reply);
 
 		if (ramp_size == 0) {
 			fprintf(stderr, _("Gamma ramp size too small: %i\n"),
 				ramp_size);
-			return -1;
+			if (state->save_ramps) {
+				xcb_discard_reply(
+					state->conn,
+					gamma_get_cookies[i].sequence);
+			}
+			randr_crtc_clear(crtc);
+			failed = 1;
+			continue;
 		}
 
-		/* Request current gamma ramps */
-		xcb_randr_get_crtc_gamma_cookie_t gamma_get_cookie =
-			xcb_randr_get_crtc_gamma(state->conn, crtc);
-		xcb_randr_get_crtc_gamma_reply_t *gamma_get_reply =
-			xcb_randr_get_crtc_gamma_reply(state->conn,
-						       gamma_get_cookie,
-						       &error);
+		/* The CRTC may have been reset, so the ramps must be
+		   applied again. */
+		crtc->applied.ramp_size = 0;
+		crtc->active = active;
+
+		xcb_randr_get_crtc_gamma_reply_t *gamma_get_reply = NULL;
+		if (state->save_ramps) {
+			/* Receive current gamma ramps */
+			gamma_get_reply = xcb_randr_get_crtc_gamma_reply(
+				state->conn, gamma_get_cookies[i], &error);
+
+			if (error) {
+				fprintf(stderr, _("`%s' returned error %d\n"),
+					"RANDR Get CRTC Gamma",
+					error->error_code);
+				free(error);
+				randr_crtc_clear(crtc);
+				failed = 1;
+				continue;
+			}
+		}
 
-		if (error) {
-			fprintf(stderr, _("`%s' returned error %d\n"),
-				"RANDR Get CRTC Gamma", error->error_code);
-			return -1;
+		/* Keep the ramps saved when the CRTC was first seen,
+		   since the current ramps may be our own. */
+		if (crtc->ramps != NULL && crtc->ramp_size == ramp_size) {
+			free(gamma_get_reply);
+			continue;
+		}
+
+		randr_crtc_clear(crtc);
+		crtc->active = active;
+
+		/* Allocate space for new gamma ramps */
+		crtc->ramps = malloc(3*ramp_size*sizeof(uint16_t));
+		if (crtc->ramps == NULL) {
+			perror("malloc");
+			free(gamma_get_reply);
+			failed = 1;
+			continue;
 		}
 
+		crtc->ramp_size = ramp_size;
+		if (gamma_get_reply == NULL) continue;
+
 		uint16_t *gamma_r =
 			xcb_randr_get_crtc_gamma_red(gamma_get_reply);
 		uint16_t *gamma_g =
@@ -232,25 +399,82 @@ randr_start(randr_state_t *state)
 			xcb_randr_get_crtc_gamma_blue(gamma_get_reply);
 
 		/* Allocate space for saved gamma ramps */
-		state->crtcs[i].saved_ramps =
-			malloc(3*ramp_size*sizeof(uint16_t));
-		if (state->crtcs[i].saved_ramps == NULL) {
+		crtc->saved_ramps = malloc(3*ramp_size*sizeof(uint16_t));
+		if (crtc->saved_ramps == NULL) {
 			perror("malloc");
 			free(gamma_get_reply);
-			return -1;
+			randr_crtc_clear(crtc);
+			failed = 1;
+			continue;
 		}
 
 		/* Copy gamma ramps into CRTC state */
-		memcpy(&state->crtcs[i].saved_ramps[0*ramp_size], gamma_r,
+		memcpy(&crtc->saved_ramps[0*ramp_size], gamma_r,
 		       ramp_size*sizeof(uint16_t));
-		memcpy(&state->crtcs[i].saved_ramps[1*ramp_size], gamma_g,
+		memcpy(&crtc->saved_ramps[1*ramp_size], gamma_g,
 		       ramp_size*sizeof(uint16_t));
-		memcpy(&state->crtcs[i].saved_ramps[2*ramp_size], gamma_b,
+		memcpy(&crtc->saved_ramps[2*ramp_size], gamma_b,
 		       ramp_size*sizeof(uint16_t));
 
 		free(gamma_get_reply);
 	}
 
+	free(gamma_size_cookies);
+	free(gamma_get_cookies);
+	free(info_cookies);
+
+	return failed ? -1 : 0;
+}
+
+static int
+randr_start(randr_state_t *state, int save_ramps)
+{
+	int r;
+
+	state->save_ramps = save_ramps;
+
+	int screen_num = state->screen_num;
+	if (screen_num < 0) screen_num = state->preferred_screen;
+
+	/* Get screen */
+	const xcb_setup_t *setup = xcb_get_setup(state->conn);
+	xcb_screen_iterator_t iter = xcb_setup_roots_iterator(setup);
+	state->screen = NULL;
+
+	for (int i = 0; iter.rem > 0; i++) {
+		if (i == screen_num) {
+			state->screen = iter.data;
+			break;
+		}
+		xcb_screen_next(&iter);
+	}
+
+	if (state->screen == NULL) {
+		fprintf(stderr, _("Screen %i could not be found.\n"),
+			screen_num);
+		return -1;
+	}
+
+	/* Save size and gamma ramps of the selected CRTCs.
+	   Current gamma ramps are saved so we can restore them
+	   at program exit. */
+	r = randr_update_crtcs(state);
+	if (r < 0) return -1;
+
+	r = randr_probe_crtcs(state);
+	if (r < 0) return -1;
+
+	/* Listen for changes of the CRTC configuration */
+	const xcb_query_extension_reply_t *ext =
+		xcb_get_extension_data(state->conn, &xcb_randr_id);
+	state->event_base = ext->first_event;
+
+	xcb_randr_select_input(state->conn, state->screen->root,
+			       XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE |
+			       XCB_RANDR_NOTIFY_MASK_CRTC_CHANGE |
+			       XCB_RANDR_NOTIFY_MASK_OUTPUT_CHANGE);
+	xcb_flush(state->conn);
+
 	return 0;
 }
 
@@ -259,26 +483,35 @@ randr_restore(randr_state_t *state)
 {
 	xcb_generic_error_t *error;
 
-	/* Restore CRTC gamma ramps */
+	/* Restore CRTC gamma ramps. All requests are sent
+	   before any of them are checked. */
 	for (int i = 0; i < state->crtc_count; i++) {
 		xcb_randr_crtc_t crtc = state->crtcs[i].crtc;
 
 		unsigned int ramp_size = state->crtcs[i].ramp_size;
+		if (state->crtcs[i].saved_ramps == NULL) continue;
 		uint16_t *gamma_r = &state->crtcs[i].saved_ramps[0*ramp_size];
 		uint16_t *gamma_g = &state->crtcs[i].saved_ramps[1*ramp_size];
 		uint16_t *gamma_b = &state->crtcs[i].saved_ramps[2*ramp_size];
 
+		state->crtcs[i].applied.ramp_size = 0;
+
 		/* Set gamma ramps */
-		xcb_void_cookie_t gamma_set_cookie =
+		state->crtcs[i].cookie =
 			xcb_randr_set_crtc_gamma_checked(state->conn, crtc,
 							 ramp_size, gamma_r,
 							 gamma_g, gamma_b);
-		error = xcb_request_check(state->conn, gamma_set_cookie);
+	}
+
+	for (int i = 0; i < state->crtc_count; i++) {
+		if (state->crtcs[i].saved_ramps == NULL) continue;
+		error = xcb_request_check(state->conn, state->crtcs[i].cookie);
 
 		if (error) {
 			fprintf(stderr, _("`%s' returned error %d\n"),
 				"RANDR Set CRTC Gamma", error->error_code);
 			fprintf(stderr, _("Unable to restore CRTC %i\n"), i);
+			free(error);
 		}
 	}
 }
@@ -288,7 +521,7 @@ randr_free(randr_state_t *state)
 {
 	/* Free CRTC state */
 	for (int i = 0; i < state->crtc_count; i++) {
-		free(state->crtcs[i].saved_ramps);
+		randr_crtc_clear(&state->crtcs[i]);
 	}
 	free(state->crtcs);
 	free(state->crtc_num);
@@ -377,13 +610,14 @@ randr_set_option(randr_state_t *state, const char *key, const char *value)
 	return 0;
 }
 
+/* Send request to set gamma ramps of CRTC without waiting for the
+   reply. Return 1 if a request was sent, 0 if the CRTC already shows
+   the ramps, or -1 on error. */
 static int
-randr_set_temperature_for_crtc(
+randr_send_temperature_for_crtc(
 	randr_state_t *state, int crtc_num, const color_setting_t *setting,
 	int preserve)
 {
-	xcb_generic_error_t *error;
-
 	if (crtc_num >= state->crtc_count || crtc_num < 0) {
 		fprintf(stderr, _("CRTC %d does not exist. "),
 			crtc_num);
@@ -399,51 +633,56 @@ randr_set_temperature_for_crtc(
 
 	xcb_randr_crtc_t crtc = state->crtcs[crtc_num].crtc;
 	unsigned int ramp_size = state->crtcs[crtc_num].ramp_size;
+	uint16_t *source = preserve ? state->crtcs[crtc_num].saved_ramps :
+		NULL;
 
-	/* Create new gamma ramps */
-	uint16_t *gamma_ramps = malloc(3*ramp_size*sizeof(uint16_t));
-	if (gamma_ramps == NULL) {
-		perror("malloc");
-		return -1;
+	/* Skip CRTC that could not be probed or is disabled */
+	if (ramp_size == 0 || !state->crtcs[crtc_num].active) return 0;
+
+	/* Skip update if the CRTC already shows these ramps */
+	colorramp_key_t *applied = &state->crtcs[crtc_num].applied;
+	if (colorramp_cache_applied(applied, ramp_size, setting, source)) {
+		return 0;
 	}
 
+	/* Create new gamma ramps */
+	uint16_t *gamma_ramps = state->crtcs[crtc_num].ramps;
 	uint16_t *gamma_r = &gamma_ramps[0*ramp_size];
 	uint16_t *gamma_g = &gamma_ramps[1*ramp_size];
 	uint16_t *gamma_b = &gamma_ramps[2*ramp_size];
 
-	if (preserve) {
-		/* Initialize gamma ramps from saved state */
-		memcpy(gamma_ramps, state->crtcs[crtc_num].saved_ramps,
-		       3*ramp_size*sizeof(uint16_t));
-	} else {
-		/* Initialize gamma ramps to pure state */
-		for (int i = 0; i < ramp_size; i++) {
-			uint16_t value = (double)i/ramp_size * (UINT16_MAX+1);
-			gamma_r[i] = value;
-			gamma_g[i] = value;
-			gamma_b[i] = value;
-		}
-	}
-
-	colorramp_fill(gamma_r, gamma_g, gamma_b, ramp_size,
-		       setting);
+	/* Create gamma ramps from saved state or pure state */
+	colorramp_cache_fill(gamma_r, gamma_g, gamma_b, ramp_size, setting,
+			     source);
 
 	/* Set new gamma ramps */
-	xcb_void_cookie_t gamma_set_cookie =
+	state->crtcs[crtc_num].cookie =
 		xcb_randr_set_crtc_gamma_checked(state->conn, crtc,
 						 ramp_size, gamma_r,
 						 gamma_g, gamma_b);
-	error = xcb_request_check(state->conn, gamma_set_cookie);
+
+	return 1;
+}
+
+/* Wait for the result of the pending request of CRTC.
+   Return -1 if the request failed. */
+static int
+randr_check_crtc(randr_state_t *state, int crtc_num)
+{
+	xcb_generic_error_t *error =
+		xcb_request_check(state->conn, state->crtcs[crtc_num].cookie);
+	state->crtcs[crtc_num].pending = 0;
 
 	if (error) {
 		fprintf(stderr, _("`%s' returned error %d\n"),
 			"RANDR Set CRTC Gamma", error->error_code);
-		free(gamma_ramps);
+		fprintf(stderr, _("Unable to set gamma ramps of CRTC %i\n"),
+			crtc_num);
+		free(error);
+		state->crtcs[crtc_num].applied.ramp_size = 0;
 		return -1;
 	}
 
-	free(gamma_ramps);
-
 	return 0;
 }
 
@@ -452,22 +691,129 @@ randr_set_temperature(
 	randr_state_t *state, const color_setting_t *setting, int preserve)
 {
 	int r;
+	int failed = 0;
 
 	/* If no CRTC numbers have been specified,
 	   set temperature on all CRTCs. */
-	if (state->crtc_num_count == 0) {
-		for (int i = 0; i < state->crtc_count; i++) {
-			r = randr_set_temperature_for_crtc(
-				state, i, setting, preserve);
-			if (r < 0) return -1;
+	int count = state->crtc_num_count == 0 ?
+		state->crtc_count : state->crtc_num_count;
+
+	/* Send requests for all CRTCs before checking any of them, so
+	   that the update only takes a single round trip. */
+	for (int i = 0; i < count; i++) {
+		int crtc_num = state->crtc_num_count == 0 ?
+			i : state->crtc_num[i];
+		r = randr_send_temperature_for_crtc(
+			state, crtc_num, setting, preserve);
+		if (r < 0) {
+			failed = 1;
+			break;
 		}
-	} else {
-		for (int i = 0; i < state->crtc_num_count; ++i) {
-			r = randr_set_temperature_for_crtc(
-				state, state->crtc_num[i], setting, preserve);
+		if (r > 0) state->crtcs[crtc_num].pending = 1;
+	}
+
+	for (int i = 0; i < state->crtc_count; i++) {
+		if (!state->crtcs[i].pending) continue;
+		r = randr_check_crtc(state, i);
+		if (r < 0) failed = 1;
+	}
+
+	return failed ? -1 : 0;
+}
+
+static int
+randr_get_fd(randr_state_t *state)
+{
+	return xcb_get_file_descriptor(state->conn);
+}
+
+/* Mark CRTC for probing if it is selected. Return 1 if marked. */
+static int
+randr_mark_crtc(randr_state_t *state, xcb_randr_crtc_t crtc)
+{
+	for (int i = 0; i < state->crtc_count; i++) {
+		if (state->crtcs[i].crtc == crtc &&
+		    randr_crtc_is_selected(state, i)) {
+			state->crtcs[i].probe = 1;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int
+randr_handle(
+	randr_state_t *state, const color_setting_t *setting, int preserve)
+{
+	int r;
+
+	/* Events may have been queued while waiting for replies, so the
+	   queue is checked even if the connection was not readable. */
+	while (1) {
+		int update = 0;
+		int changed = 0;
+
+		xcb_generic_event_t *event;
+		while ((event = xcb_poll_for_event(state->conn)) != NULL) {
+			int type = event->response_type & ~0x80;
+			if (type == state->event_base +
+			    XCB_RANDR_SCREEN_CHANGE_NOTIFY) {
+				update = 1;
+			} else if (type == state->event_base +
+				   XCB_RANDR_NOTIFY) {
+				xcb_randr_notify_event_t *notify =
+					(xcb_randr_notify_event_t *)event;
+				if (notify->subCode ==
+				    XCB_RANDR_NOTIFY_CRTC_CHANGE) {
+					/* Probe only the CRTC
+					   that changed */
+					changed |= randr_mark_crtc(
+						state, notify->u.cc.crtc);
+				} else {
+					update = 1;
+				}
+			}
+			free(event);
+		}
+
+		if (xcb_connection_has_error(state->conn)) {
+			fputs(_("Connection to X server was lost.\n"),
+			      stderr);
+			return -1;
+		}
+
+		if (!update && !changed) break;
+
+		/* Changes of screen and outputs can add or
+		   remove CRTCs. */
+		if (update) {
+			r = randr_update_crtcs(state);
 			if (r < 0) return -1;
 		}
+
+		/* CRTCs that fail to be probed are skipped until
+		   they change again. */
+		randr_probe_crtcs(state);
+
+		r = randr_set_temperature(state, setting, preserve);
+		if (r < 0) return -1;
+	}
+
+	return 0;
+}
+
+static int
+randr_get_crtc_count(randr_state_t *state, int *active, int *total)
+{
+	*active = 0;
+	for (int i = 0; i < state->crtc_count; i++) {
+		if (state->crtcs[i].active &&
+		    randr_crtc_is_selected(state, i)) {
+			*active += 1;
+		}
 	}
+	*total = state->crtc_count;
 
 	return 0;
 }
@@ -481,5 +827,8 @@ const gamma_method_t randr_gamma_method = {
 	(gamma_method_print_help_func *)randr_print_help,
 	(gamma_method_set_option_func *)randr_set_option,
 	(gamma_method_restore_func *)randr_restore,
-	(gamma_method_set_temperature_func *)randr_set_temperature
+	(gamma_method_set_temperature_func *)randr_set_temperature,
+	(gamma_method_get_fd_func *)randr_get_fd,
+	(gamma_method_handle_func *)randr_handle,
+	(gamma_method_get_crtc_count_func *)randr_get_crtc_count
 };
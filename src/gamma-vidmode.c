@@ -38,7 +38,7 @@
 
 #include "gamma-vidmode.h"
 #include "redshift.h"
-#include "colorramp.h"
+#include "colorramp-cache.h"
 
 
 typedef struct {
@@ -46,6 +46,10 @@ typedef struct {
 	int screen_num;
 	int ramp_size;
 	uint16_t *saved_ramps;
+	/* Buffer for new gamma ramps */
+	uint16_t *ramps;
+	/* Key of the ramps last applied */
+	colorramp_key_t applied;
 } vidmode_state_t;
 
 
@@ -58,6 +62,8 @@ vidmode_init(vidmode_state_t **state)
 	vidmode_state_t *s = *state;
 	s->screen_num = -1;
 	s->saved_ramps = NULL;
+	s->ramps = NULL;
+	s->applied.ramp_size = 0;
 
 	/* Open display */
 	s->display = XOpenDisplay(NULL);
@@ -70,7 +76,7 @@ vidmode_init(vidmode_state_t **state)
 }
 
 static int
-vidmode_start(vidmode_state_t *state)
+vidmode_start(vidmode_state_t *state, int save_ramps)
 {
 	int r;
 	int screen_num = state->screen_num;
@@ -102,6 +108,15 @@ vidmode_start(vidmode_state_t *state)
 		return -1;
 	}
 
+	/* Allocate space for new gamma ramps */
+	state->ramps = malloc(3*state->ramp_size*sizeof(uint16_t));
+	if (state->ramps == NULL) {
+		perror("malloc");
+		return -1;
+	}
+
+	if (!save_ramps) return 0;
+
 	/* Allocate space for saved gamma ramps */
 	state->saved_ramps = malloc(3*state->ramp_size*sizeof(uint16_t));
 	if (state->saved_ramps == NULL) {
@@ -130,7 +145,9 @@ static void
 vidmode_free(vidmode_state_t *state)
 {
 	/* Free saved ramps */
+	colorramp_cache_invalidate(state->saved_ramps);
 	free(state->saved_ramps);
+	free(state->ramps);
 
 	/* Close display connection */
 	XCloseDisplay(state->display);
@@ -172,10 +189,14 @@ vidmode_set_option(vidmode_state_t *state, const char *key, const char *value)
 static void
 vidmode_restore(vidmode_state_t *state)
 {
+	if (state->saved_ramps == NULL) return;
+
 	uint16_t *gamma_r = &state->saved_ramps[0*state->ramp_size];
 	uint16_t *gamma_g = &state->saved_ramps[1*state->ramp_size];
 	uint16_t *gamma_b = &state->saved_ramps[2*state->ramp_size];
 
+	state->applied.ramp_size = 0;
+
 	/* Restore gamma ramps */
 	int r = XF86VidModeSetGammaRamp(state->display, state->screen_num,
 					state->ramp_size, gamma_r, gamma_g,
@@ -191,35 +212,23 @@ vidmode_set_temperature(
 	vidmode_state_t *state, const color_setting_t *setting, int preserve)
 {
 	int r;
+	uint16_t *source = preserve ? state->saved_ramps : NULL;
 
-	/* Create new gamma ramps */
-	uint16_t *gamma_ramps = malloc(3*state->ramp_size*sizeof(uint16_t));
-	if (gamma_ramps == NULL) {
-		perror("malloc");
-		return -1;
+	/* Skip update if these ramps are already applied */
+	if (colorramp_cache_applied(&state->applied, state->ramp_size,
+				    setting, source)) {
+		return 0;
 	}
 
+	/* Create new gamma ramps */
+	uint16_t *gamma_ramps = state->ramps;
 	uint16_t *gamma_r = &gamma_ramps[0*state->ramp_size];
 	uint16_t *gamma_g = &gamma_ramps[1*state->ramp_size];
 	uint16_t *gamma_b = &gamma_ramps[2*state->ramp_size];
 
-	if (preserve) {
-		/* Initialize gamma ramps from saved state */
-		memcpy(gamma_ramps, state->saved_ramps,
-		       3*state->ramp_size*sizeof(uint16_t));
-	} else {
-		/* Initialize gamma ramps to pure state */
-		for (int i = 0; i < state->ramp_size; i++) {
-			uint16_t value = (double)i/state->ramp_size *
-				(UINT16_MAX+1);
-			gamma_r[i] = value;
-			gamma_g[i] = value;
-			gamma_b[i] = value;
-		}
-	}
-
-	colorramp_fill(gamma_r, gamma_g, gamma_b, state->ramp_size,
-		       setting);
+	/* Create gamma ramps from saved state or pure state */
+	colorramp_cache_fill(gamma_r, gamma_g, gamma_b, state->ramp_size,
+			     setting, source);
 
 	/* Set new gamma ramps */
 	r = XF86VidModeSetGammaRamp(state->display, state->screen_num,
@@ -228,15 +237,32 @@ vidmode_set_temperature(
 	if (!r) {
 		fprintf(stderr, _("X request failed: %s\n"),
 			"XF86VidModeSetGammaRamp");
-		free(gamma_ramps);
+		state->applied.ramp_size = 0;
 		return -1;
 	}
 
-	free(gamma_ramps);
+	return 0;
+}
 
+static int
+vidmode_get_fd(vidmode_state_t *state)
+{
+	return -1;
+}
+
+static int
+vidmode_handle(
+	vidmode_state_t *state, const color_setting_t *setting, int preserve)
+{
 	return 0;
 }
 
+static int
+vidmode_get_crtc_count(vidmode_state_t *state, int *active, int *total)
+{
+	return -1;
+}
+
 
 const gamma_method_t vidmode_gamma_method = {
 	"vidmode", 1,
@@ -246,5 +272,8 @@ const gamma_method_t vidmode_gamma_method = {
 	(gamma_method_print_help_func *)vidmode_print_help,
 	(gamma_method_set_option_func *)vidmode_set_option,
 	(gamma_method_restore_func *)vidmode_restore,
-	(gamma_method_set_temperature_func *)vidmode_set_temperature
+	(gamma_method_set_temperature_func *)vidmode_set_temperature,
+	(gamma_method_get_fd_func *)vidmode_get_fd,
+	(gamma_method_handle_func *)vidmode_handle,
+	(gamma_method_get_crtc_count_func *)vidmode_get_crtc_count
 };
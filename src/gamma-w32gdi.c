@@ -38,7 +38,7 @@
 #endif
 
 #include "gamma-w32gdi.h"
-#include "colorramp.h"
+#include "colorramp-cache.h"
 
 #define GAMMA_RAMP_SIZE  256
 #define MAX_ATTEMPTS  10
@@ -46,6 +46,10 @@
 
 typedef struct {
 	WORD *saved_ramps;
+	/* Buffer for new gamma ramps */
+	WORD ramps[3*GAMMA_RAMP_SIZE];
+	/* Key of the ramps last applied */
+	colorramp_key_t applied;
 } w32gdi_state_t;
 
 
@@ -57,12 +61,13 @@ w32gdi_init(w32gdi_state_t **state)
 
 	w32gdi_state_t *s = *state;
 	s->saved_ramps = NULL;
+	s->applied.ramp_size = 0;
 
 	return 0;
 }
 
 static int
-w32gdi_start(w32gdi_state_t *state)
+w32gdi_start(w32gdi_state_t *state, int save_ramps)
 {
 	BOOL r;
 
@@ -81,6 +86,11 @@ w32gdi_start(w32gdi_state_t *state)
 		return -1;
 	}
 
+	if (!save_ramps) {
+		ReleaseDC(NULL, hDC);
+		return 0;
+	}
+
 	/* Allocate space for saved gamma ramps */
 	state->saved_ramps = malloc(3*GAMMA_RAMP_SIZE*sizeof(WORD));
 	if (state->saved_ramps == NULL) {
@@ -107,6 +117,7 @@ static void
 w32gdi_free(w32gdi_state_t *state)
 {
 	/* Free saved ramps */
+	colorramp_cache_invalidate(state->saved_ramps);
 	free(state->saved_ramps);
 
 	free(state);
@@ -139,6 +150,9 @@ w32gdi_set_option(w32gdi_state_t *state, const char *key, const char *value)
 static void
 w32gdi_restore(w32gdi_state_t *state)
 {
+	state->applied.ramp_size = 0;
+	if (state->saved_ramps == NULL) return;
+
 	/* Open device context */
 	HDC hDC = GetDC(NULL);
 	if (hDC == NULL) {
@@ -165,43 +179,31 @@ w32gdi_set_temperature(
 	w32gdi_state_t *state, const color_setting_t *setting, int preserve)
 {
 	BOOL r;
+	WORD *source = preserve ? state->saved_ramps : NULL;
+
+	/* Skip update if these ramps are already applied */
+	if (colorramp_cache_applied(&state->applied, GAMMA_RAMP_SIZE,
+				    setting, source)) {
+		return 0;
+	}
 
 	/* Open device context */
 	HDC hDC = GetDC(NULL);
 	if (hDC == NULL) {
 		fputs(_("Unable to open device context.\n"), stderr);
+		state->applied.ramp_size = 0;
 		return -1;
 	}
 
 	/* Create new gamma ramps */
-	WORD *gamma_ramps = malloc(3*GAMMA_RAMP_SIZE*sizeof(WORD));
-	if (gamma_ramps == NULL) {
-		perror("malloc");
-		ReleaseDC(NULL, hDC);
-		return -1;
-	}
-
+	WORD *gamma_ramps = state->ramps;
 	WORD *gamma_r = &gamma_ramps[0*GAMMA_RAMP_SIZE];
 	WORD *gamma_g = &gamma_ramps[1*GAMMA_RAMP_SIZE];
 	WORD *gamma_b = &gamma_ramps[2*GAMMA_RAMP_SIZE];
 
-	if (preserve) {
-		/* Initialize gamma ramps from saved state */
-		memcpy(gamma_ramps, state->saved_ramps,
-		       3*GAMMA_RAMP_SIZE*sizeof(WORD));
-	} else {
-		/* Initialize gamma ramps to pure state */
-		for (int i = 0; i < GAMMA_RAMP_SIZE; i++) {
-			WORD value = (double)i/GAMMA_RAMP_SIZE *
-				(UINT16_MAX+1);
-			gamma_r[i] = value;
-			gamma_g[i] = value;
-			gamma_b[i] = value;
-		}
-	}
-
-	colorramp_fill(gamma_r, gamma_g, gamma_b, GAMMA_RAMP_SIZE,
-		       setting);
+	/* Create gamma ramps from saved state or pure state */
+	colorramp_cache_fill(gamma_r, gamma_g, gamma_b, GAMMA_RAMP_SIZE,
+			     setting, source);
 
 	/* Set new gamma ramps */
 	r = FALSE;
@@ -213,19 +215,36 @@ w32gdi_set_temperature(
 	}
 	if (!r) {
 		fputs(_("Unable to set gamma ramps.\n"), stderr);
-		free(gamma_ramps);
+		state->applied.ramp_size = 0;
 		ReleaseDC(NULL, hDC);
 		return -1;
 	}
 
-	free(gamma_ramps);
-
 	/* Release device context */
 	ReleaseDC(NULL, hDC);
 
 	return 0;
 }
 
+static int
+w32gdi_get_fd(w32gdi_state_t *state)
+{
+	return -1;
+}
+
+static int
+w32gdi_handle(
+	w32gdi_state_t *state, const color_setting_t *setting, int preserve)
+{
+	return 0;
+}
+
+static int
+w32gdi_get_crtc_count(w32gdi_state_t *state, int *active, int *total)
+{
+	return -1;
+}
+
 
 const gamma_method_t w32gdi_gamma_method = {
 	"wingdi", 1,
@@ -235,5 +254,8 @@ const gamma_method_t w32gdi_gamma_method = {
 	(gamma_method_print_help_func *)w32gdi_print_help,
 	(gamma_method_set_option_func *)w32gdi_set_option,
 	(gamma_method_restore_func *)w32gdi_restore,
-	(gamma_method_set_temperature_func *)w32gdi_set_temperature
+	(gamma_method_set_temperature_func *)w32gdi_set_temperature,
+	(gamma_method_get_fd_func *)w32gdi_get_fd,
+	(gamma_method_handle_func *)w32gdi_handle,
+	(gamma_method_get_crtc_count_func *)w32gdi_get_crtc_count
 };
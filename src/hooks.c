@@ -28,6 +28,7 @@
 
 #include "hooks.h"
 #include "redshift.h"
+#include "signals.h"
 
 #define MAX_HOOK_PATH  4096
 
@@ -98,6 +99,7 @@ hooks_signal_period_change(period_t prev_period, period_t period)
 			continue;
 		} else if (pid == 0) { /* Child */
 			close(STDOUT_FILENO);
+			signals_unblock();
 
 			int r = execl(hook_path, hook_name,
 				      "period-changed",
@@ -52,6 +52,10 @@
 #define DEFAULT_BRIGHTNESS   1.0
 #define DEFAULT_GAMMA        1.0
 
+/* Default fade of 40 frames at 100 ms intervals */
+#define DEFAULT_FADE_DURATION  4.0
+#define DEFAULT_FADE_FPS      10.0
+
 
 /* A brightness string contains either one floating point value,
    or two values separated by a colon. */
@@ -96,6 +100,28 @@ parse_gamma_string(const char *str, float gamma[])
 	return 0;
 }
 
+/* A simulation string contains start and end time as seconds since
+   the epoch and the speed, separated by colons. */
+static int
+parse_simulation_string(
+	const char *str, double *start, double *end, double *speed)
+{
+	char *s;
+	errno = 0;
+	*start = strtod(str, &s);
+	if (errno != 0 || s == str || *s != ':') return -1;
+
+	str = s + 1;
+	*end = strtod(str, &s);
+	if (errno != 0 || s == str || *s != ':') return -1;
+
+	str = s + 1;
+	*speed = strtod(str, &s);
+	if (errno != 0 || s == str || *s != '\0') return -1;
+
+	return 0;
+}
+
 /* Parse transition time string e.g. "04:50". Returns negative on failure,
    otherwise the parsed time is returned as seconds since midnight. */
 static int
@@ -177,6 +203,8 @@ print_help(const char *program_name)
 	   `list' must not be translated
 	   no-wrap */
 	fputs(_("  -b DAY:NIGHT\tScreen brightness to apply (between 0.1 and 1.0)\n"
+		"  -B FILE\tBatch mode (print settings for each `LAT LON TIME'\n"
+		"  \t\trecord in FILE, or standard input if FILE is `-')\n"
 		"  -c FILE\tLoad settings from specified configuration file\n"
 		"  -g R:G:B\tAdditional gamma correction to apply\n"
 		"  -l LAT:LON\tYour current location\n"
@@ -193,6 +221,10 @@ print_help(const char *program_name)
 		" color effect\n"
 		"  -x\t\tReset mode (remove adjustment from screen)\n"
 		"  -r\t\tDisable fading between color temperatures\n"
+		"  -S START:END:SPEED\n"
+		"  \t\tSimulate continual mode from START to END (seconds\n"
+		"  \t\tsince the epoch) at SPEED times real time, or as fast\n"
+		"  \t\tas possible if SPEED is 0, printing applied settings\n"
 		"  -t DAY:NIGHT\tColor temperature to set at daytime/night\n"),
 	      stdout);
 	fputs("\n", stdout);
@@ -319,7 +351,17 @@ options_init(options_t *options)
 	options->provider = NULL;
 	options->provider_args = NULL;
 
+	options->batch_filepath = NULL;
+
+	options->sim_start = NAN;
+	options->sim_end = NAN;
+	options->sim_speed = NAN;
+
+	options->control_socket = NULL;
+
 	options->use_fade = -1;
+	options->fade_duration = NAN;
+	options->fade_fps = NAN;
 	options->preserve_gamma = 1;
 	options->mode = PROGRAM_MODE_CONTINUAL;
 	options->verbose = 0;
@@ -336,6 +378,10 @@ parse_command_line_option(
 	char *s;
 
 	switch (option) {
+	case 'B':
+		options->mode = PROGRAM_MODE_BATCH;
+		options->batch_filepath = value;
+		break;
 	case 'b':
 		parse_brightness_string(
 			value, &options->scheme.day.brightness,
@@ -456,6 +502,18 @@ parse_command_line_option(
 	case 'r':
 		options->use_fade = 0;
 		break;
+	case 'S':
+		r = parse_simulation_string(
+			value, &options->sim_start, &options->sim_end,
+			&options->sim_speed);
+		if (r < 0 || !(options->sim_end > options->sim_start) ||
+		    !(options->sim_speed >= 0.0)) {
+			fputs(_("Malformed simulation argument.\n"), stderr);
+			fputs(_("Try `-h' for more information.\n"), stderr);
+			return -1;
+		}
+		options->mode = PROGRAM_MODE_CONTINUAL;
+		break;
 	case 't':
 		s = strchr(value, ':');
 		if (s == NULL) {
@@ -495,7 +553,7 @@ options_parse_args(
 {
 	const char* program_name = argv[0];
 	int opt;
-	while ((opt = getopt(argc, argv, "b:c:g:hl:m:oO:pPrt:vVx")) != -1) {
+	while ((opt = getopt(argc, argv, "b:B:c:g:hl:m:oO:pPrS:t:vVx")) != -1) {
 		char option = opt;
 		int r = parse_command_line_option(
 			option, optarg, options, program_name, gamma_methods,
@@ -526,6 +584,14 @@ parse_config_file_option(
 		if (options->use_fade < 0) {
 			options->use_fade = !!atoi(value);
 		}
+	} else if (strcasecmp(key, "fade-duration") == 0) {
+		if (isnan(options->fade_duration)) {
+			options->fade_duration = atof(value);
+		}
+	} else if (strcasecmp(key, "fade-fps") == 0) {
+		if (isnan(options->fade_fps)) {
+			options->fade_fps = atof(value);
+		}
 	} else if (strcasecmp(key, "brightness") == 0) {
 		if (isnan(options->scheme.day.brightness)) {
 			options->scheme.day.brightness = atof(value);
@@ -595,6 +661,14 @@ parse_config_file_option(
 				return -1;
 			}
 		}
+	} else if (strcasecmp(key, "control-socket") == 0) {
+		if (options->control_socket == NULL) {
+			options->control_socket = strdup(value);
+			if (options->control_socket == NULL) {
+				perror("strdup");
+				return -1;
+			}
+		}
 	} else if (strcasecmp(key, "dawn-time") == 0) {
 		if (options->scheme.dawn.start < 0) {
 			int r = parse_transition_range(
@@ -623,8 +697,8 @@ parse_config_file_option(
 	return 0;
 }
 
-/* Parse options defined in the config file. */
-void
+/* Parse options defined in the config file. Return -1 on error. */
+int
 options_parse_config_file(
 	options_t *options, config_ini_state_t *config_state,
 	const gamma_method_t *gamma_methods,
@@ -633,17 +707,19 @@ options_parse_config_file(
 	/* Read global config settings. */
 	config_ini_section_t *section = config_ini_get_section(
 		config_state, "redshift");
-	if (section == NULL) return;
+	if (section == NULL) return 0;
 
 	config_ini_setting_t *setting = section->settings;
 	while (setting != NULL) {
 		int r = parse_config_file_option(
 			setting->name, setting->value, options,
 			gamma_methods, location_providers);
-		if (r < 0) exit(EXIT_FAILURE);
+		if (r < 0) return -1;
 
 		setting = setting->next;
 	}
+
+	return 0;
 }
 
 /* Replace unspecified options with default values. */
@@ -676,4 +752,8 @@ options_set_defaults(options_t *options)
 	}
 
 	if (options->use_fade < 0) options->use_fade = 1;
+	if (isnan(options->fade_duration)) {
+		options->fade_duration = DEFAULT_FADE_DURATION;
+	}
+	if (isnan(options->fade_fps)) options->fade_fps = DEFAULT_FADE_FPS;
 }
@@ -34,6 +34,9 @@ typedef struct {
 	int temp_set;
 	/* Whether to fade between large skips in color temperature. */
 	int use_fade;
+	/* Duration of fade (seconds) and its frames per second. */
+	double fade_duration;
+	double fade_fps;
 	/* Whether to preserve gamma ramps if supported by gamma method. */
 	int preserve_gamma;
 
@@ -42,6 +45,18 @@ typedef struct {
 	/* Arguments for gamma method. */
 	char *method_args;
 
+	/* Input file for batch mode. */
+	char *batch_filepath;
+
+	/* Simulated time span (seconds since epoch) and speed, or NAN
+	   if not simulating. */
+	double sim_start;
+	double sim_end;
+	double sim_speed;
+
+	/* Path of control socket, or NULL if not enabled. */
+	char *control_socket;
+
 	/* Selected location provider. */
 	const location_provider_t *provider;
 	/* Arguments for location provider. */
@@ -54,7 +69,7 @@ void options_parse_args(
 	options_t *options, int argc, char *argv[],
 	const gamma_method_t *gamma_methods,
 	const location_provider_t *location_providers);
-void options_parse_config_file(
+int options_parse_config_file(
 	options_t *options, config_ini_state_t *config_state,
 	const gamma_method_t *gamma_methods,
 	const location_provider_t *location_providers);
@@ -65,7 +65,11 @@ int poll(struct pollfd *fds, int nfds, int timeout) { abort(); return -1; }
 #include "systemtime.h"
 #include "hooks.h"
 #include "signals.h"
+#include "eventloop.h"
+#include "control.h"
 #include "options.h"
+#include "colorramp-cache.h"
+#include "batch.h"
 
 /* pause() is not defined on windows platform but is not needed either.
    Use a noop macro instead. */
@@ -109,25 +113,32 @@ int poll(struct pollfd *fds, int nfds, int timeout) { abort(); return -1; }
 #undef CLAMP
 #define CLAMP(lo,mid,up)  (((lo) > (mid)) ? (lo) : (((mid) < (up)) ? (mid) : (up)))
 
+#undef MIN
+#define MIN(x,y)  ((x) < (y) ? (x) : (y))
+#undef MAX
+#define MAX(x,y)  ((x) > (y) ? (x) : (y))
+
 
 /* Bounds for parameters. */
 #define MIN_LAT   -90.0
 #define MAX_LAT    90.0
 #define MIN_LON  -180.0
 #define MAX_LON   180.0
-#define MIN_TEMP   1000
-#define MAX_TEMP  25000
-#define MIN_BRIGHTNESS  0.1
-#define MAX_BRIGHTNESS  1.0
 #define MIN_GAMMA   0.1
 #define MAX_GAMMA  10.0
+#define MIN_FADE_DURATION   0.1
+#define MAX_FADE_DURATION  60.0
+#define MIN_FADE_FPS    1.0
+#define MAX_FADE_FPS  240.0
 
 /* Duration of sleep between screen updates (milliseconds). */
 #define SLEEP_DURATION        5000
-#define SLEEP_DURATION_SHORT  100
+/* Longest sleep when the target color setting is not changing. */
+#define SLEEP_DURATION_MAX    (60*60*1000)
 
-/* Length of fade in numbers of short sleep durations. */
-#define FADE_LENGTH  40
+/* Largest step when searching for the next change of the target
+   color setting (seconds). Shorter transitions may be missed. */
+#define SCHEDULE_MAX_STEP  (10*60)
 
 
 /* Names of periods of day */
@@ -205,11 +216,11 @@ get_transition_progress_from_elevation(
 	}
 }
 
-/* Return number of seconds since midnight from timestamp. */
+/* Return number of seconds since midnight from time in local time.
+   Safe to call from multiple threads. */
 static int
-get_seconds_since_midnight(double timestamp)
+lookup_seconds_since_midnight(time_t t)
 {
-	time_t t = (time_t)timestamp;
 	struct tm tm;
 #ifdef _WIN32
 	localtime_s(&tm, &t);
@@ -219,6 +230,25 @@ get_seconds_since_midnight(double timestamp)
 	return tm.tm_sec + tm.tm_min * 60 + tm.tm_hour * 3600;
 }
 
+/* Return number of seconds since midnight from timestamp.
+   Time zone offsets only change on quarter hour boundaries, so the
+   local time is only looked up once per quarter hour. */
+static int
+get_seconds_since_midnight(double timestamp)
+{
+	static time_t cached_window = -1;
+	static int cached_seconds = 0;
+
+	time_t t = (time_t)timestamp;
+	time_t window = t - ((t % 900) + 900) % 900;
+	if (window != cached_window) {
+		cached_window = window;
+		cached_seconds = lookup_seconds_since_midnight(window);
+	}
+
+	return (cached_seconds + (int)(t - window)) % 86400;
+}
+
 /* Print verbose description of the given period. */
 static void
 print_period(period_t period, double transition)
@@ -412,7 +442,8 @@ provider_try_start(const location_provider_t *provider,
 
 static int
 method_try_start(const gamma_method_t *method,
-		 gamma_state_t **state, config_ini_state_t *config, char *args)
+		 gamma_state_t **state, config_ini_state_t *config, char *args,
+		 int save_ramps)
 {
 	int r;
 
@@ -477,7 +508,7 @@ method_try_start(const gamma_method_t *method,
 	}
 
 	/* Start method. */
-	r = method->start(*state);
+	r = method->start(*state, save_ramps);
 	if (r < 0) {
 		method->free(*state);
 		fprintf(stderr, _("Failed to start adjustment method %s.\n"),
@@ -528,6 +559,81 @@ location_is_valid(const location_t *location)
 	return 1;
 }
 
+/* Check transition scheme and enable dawn/dusk times if they are set.
+   The elevation and temperatures are only checked for modes that use
+   them. Prints error message on stderr and returns -1 if invalid,
+   otherwise returns 0. */
+static int
+scheme_check(transition_scheme_t *scheme, program_mode_t mode)
+{
+	/* Dawn/dusk times */
+	if (scheme->dawn.start >= 0 || scheme->dawn.end >= 0 ||
+	    scheme->dusk.start >= 0 || scheme->dusk.end >= 0) {
+		if (scheme->dawn.start < 0 || scheme->dawn.end < 0 ||
+		    scheme->dusk.start < 0 || scheme->dusk.end < 0) {
+			fputs(_("Partitial time-configuration not"
+				" supported!\n"), stderr);
+			return -1;
+		}
+
+		if (scheme->dawn.start > scheme->dawn.end ||
+		    scheme->dawn.end > scheme->dusk.start ||
+		    scheme->dusk.start > scheme->dusk.end) {
+			fputs(_("Invalid dawn/dusk time configuration!\n"),
+			      stderr);
+			return -1;
+		}
+
+		scheme->use_time = 1;
+	}
+
+	int use_scheme =
+		mode != PROGRAM_MODE_RESET &&
+		mode != PROGRAM_MODE_MANUAL;
+
+	/* Solar elevations */
+	if (use_scheme && !scheme->use_time && scheme->high < scheme->low) {
+		fprintf(stderr,
+			_("High transition elevation cannot be lower than"
+			  " the low transition elevation.\n"));
+		return -1;
+	}
+
+	/* Color temperature */
+	if (use_scheme &&
+	    (scheme->day.temperature < MIN_TEMP ||
+	     scheme->day.temperature > MAX_TEMP ||
+	     scheme->night.temperature < MIN_TEMP ||
+	     scheme->night.temperature > MAX_TEMP)) {
+		fprintf(stderr,
+			_("Temperature must be between %uK and %uK.\n"),
+			MIN_TEMP, MAX_TEMP);
+		return -1;
+	}
+
+	/* Brightness */
+	if (scheme->day.brightness < MIN_BRIGHTNESS ||
+	    scheme->day.brightness > MAX_BRIGHTNESS ||
+	    scheme->night.brightness < MIN_BRIGHTNESS ||
+	    scheme->night.brightness > MAX_BRIGHTNESS) {
+		fprintf(stderr,
+			_("Brightness values must be between %.1f and %.1f.\n"),
+			MIN_BRIGHTNESS, MAX_BRIGHTNESS);
+		return -1;
+	}
+
+	/* Gamma */
+	if (!gamma_is_valid(scheme->day.gamma) ||
+	    !gamma_is_valid(scheme->night.gamma)) {
+		fprintf(stderr,
+			_("Gamma value must be between %.1f and %.1f.\n"),
+			MIN_GAMMA, MAX_GAMMA);
+		return -1;
+	}
+
+	return 0;
+}
+
 /* Wait for location to become available from provider.
    Waits until timeout (milliseconds) has elapsed or forever if timeout
    is -1. Writes location to loc. Returns -1 on error,
@@ -538,7 +644,7 @@ provider_get_location(
 	int timeout, location_t *loc)
 {
 	int available = 0;
-	struct pollfd pollfds[1];
+	struct pollfd pollfds[2];
 	while (!available) {
 		int loc_fd = provider->get_fd(state);
 		if (loc_fd >= 0) {
@@ -552,10 +658,22 @@ provider_get_location(
 				return -1;
 			}
 
-			/* Poll on file descriptor until ready. */
+			/* Poll on file descriptor until ready. Signals
+			   may be read from an fd, in which case they do
+			   not interrupt poll. */
 			pollfds[0].fd = loc_fd;
 			pollfds[0].events = POLLIN;
-			r = poll(pollfds, 1, timeout);
+			pollfds[0].revents = 0;
+			int nfds = 1;
+			int signal_fd = signals_get_fd();
+			if (signal_fd >= 0) {
+				pollfds[1].fd = signal_fd;
+				pollfds[1].events = POLLIN;
+				pollfds[1].revents = 0;
+				nfds += 1;
+			}
+
+			r = poll(pollfds, nfds, timeout);
 			if (r < 0) {
 				perror("poll");
 				return -1;
@@ -576,6 +694,12 @@ provider_get_location(
 				timeout -= (later - now) * 1000;
 				timeout = timeout < 0 ? 0 : timeout;
 			}
+
+			if (nfds > 1 && pollfds[1].revents != 0) {
+				signals_handle_fd();
+				if (exiting) return -1;
+			}
+			if (pollfds[0].revents == 0) continue;
 		}
 
 
@@ -597,27 +721,174 @@ ease_fade(double t)
 		-6.4041738958415664 * exp(-7.2908241330981340 * t));
 }
 
+/* Get color setting of the given frame of a fade. */
+static void
+get_fade_frame(
+	const color_setting_t *start, const color_setting_t *target,
+	int fade_frame, int fade_frames, color_setting_t *result)
+{
+	double frac = fade_frame / (double)fade_frames;
+	double alpha = CLAMP(0.0, ease_fade(frac), 1.0);
+
+	interpolate_color_settings(start, target, alpha, result);
+}
+
+/* Generate ramps for the remaining frames of a fade up front so that
+   applying each frame only needs a copy. The frames buffer must have
+   room for fade_frames settings. If it is NULL, the plan is dropped. */
+static void
+plan_fade(
+	const color_setting_t *start, const color_setting_t *target,
+	int fade_frame, int fade_frames, color_setting_t *frames)
+{
+	/* The last frame is the target itself. */
+	int count = fade_frames - fade_frame;
+	if (frames == NULL || count <= 0) {
+		colorramp_cache_plan(NULL, 0);
+		return;
+	}
+
+	for (int i = 0; i < count; i++) {
+		get_fade_frame(start, target, fade_frame + i, fade_frames,
+			       &frames[i]);
+	}
+
+	colorramp_cache_plan(frames, count);
+}
+
+/* Get period, transition progress and target color setting at the
+   given time. Solar elevation is evaluated from timeline. */
+static void
+get_target_setting(
+	const transition_scheme_t *scheme, const location_t *loc,
+	solar_timeline_t *timeline, double now, period_t *period, double *transition_prog,
+	color_setting_t *target)
+{
+	if (scheme->use_time) {
+		int time_offset = get_seconds_since_midnight(now);
+
+		*period = get_period_from_time(scheme, time_offset);
+		*transition_prog = get_transition_progress_from_time(
+			scheme, time_offset);
+	} else {
+		/* Current angular elevation of the sun */
+		double elevation = solar_timeline_elevation(
+			timeline, now, loc->lat, loc->lon);
+
+		*period = get_period_from_elevation(scheme, elevation);
+		*transition_prog =
+			get_transition_progress_from_elevation(
+				scheme, elevation);
+	}
+
+	/* Use transition progress to get target color
+	   temperature. */
+	interpolate_transition_scheme(scheme, *transition_prog, target);
+}
+
+/* Return 1 if the target color setting at time differs from the
+   quantized setting in key. */
+static int
+target_changes_at(
+	const transition_scheme_t *scheme, const location_t *loc,
+	solar_timeline_t *timeline, double time, const colorramp_key_t *key)
+{
+	period_t period;
+	double transition_prog;
+	color_setting_t target;
+	get_target_setting(scheme, loc, timeline, time, &period,
+			   &transition_prog, &target);
+
+	colorramp_key_t target_key;
+	colorramp_cache_key(&target_key, 0, &target, NULL);
+	return !colorramp_cache_key_equal(&target_key, key);
+}
+
+/* Return milliseconds until the target color setting will next change
+   from target, i.e. until the temperature moves by at least 1K or
+   brightness or gamma by one quantization step. The result is between
+   SLEEP_DURATION and SLEEP_DURATION_MAX. */
+static int
+get_next_change_delay(
+	const transition_scheme_t *scheme, const location_t *loc,
+	solar_timeline_t *timeline, double now, const color_setting_t *target)
+{
+	colorramp_key_t key;
+	colorramp_cache_key(&key, 0, target, NULL);
+
+	/* Probe with growing steps to find an interval
+	   that contains the change. */
+	double max = SLEEP_DURATION_MAX / 1000.0;
+	double step = SLEEP_DURATION / 1000.0;
+	double lo = 0.0;
+	double hi = -1.0;
+	while (lo < max) {
+		double t = MIN(lo + step, max);
+		if (target_changes_at(scheme, loc, timeline, now + t, &key)) {
+			hi = t;
+			break;
+		}
+		lo = t;
+		step = MIN(2*step, SCHEDULE_MAX_STEP);
+	}
+
+	if (hi < 0.0) return SLEEP_DURATION_MAX;
+
+	/* Bisect down to one second. */
+	while (hi - lo > 1.0) {
+		double mid = (lo + hi) / 2.0;
+		if (target_changes_at(scheme, loc, timeline, now + mid, &key)) {
+			hi = mid;
+		} else {
+			lo = mid;
+		}
+	}
+
+	return CLAMP(SLEEP_DURATION, (int)(hi*1000.0), SLEEP_DURATION_MAX);
+}
+
 
 /* Run continual mode loop
    This is the main loop of the continual mode which keeps track of the
    current time and continuously updates the screen to the appropriate
-   color temperature. */
+   color temperature. When simulating on the virtual clock, the loop
+   stops at end_time and prints each applied setting; end_time is NAN
+   otherwise. */
 static int
 run_continual_mode(const location_provider_t *provider,
 		   location_state_t *location_state,
 		   const transition_scheme_t *scheme,
 		   const gamma_method_t *method,
 		   gamma_state_t *method_state,
-		   int use_fade, int preserve_gamma, int verbose)
+		   int use_fade, double fade_duration, double fade_fps,
+		   int preserve_gamma, double end_time, int verbose)
 {
 	int r;
 
-	/* Short fade parameters */
-	int fade_length = 0;
-	int fade_time = 0;
+	/* Last printed setting when simulating. Cleared so that the
+	   first setting is printed. */
+	int simulate = !isnan(end_time);
+	color_setting_t printed_interp;
+	memset(&printed_interp, 0, sizeof(color_setting_t));
+
+	/* Short fade parameters. Frames of a fade are shown at the
+	   frame rate, timed from the monotonic start time of the fade. */
+	int fade_frames = MAX(1, lround(fade_duration*fade_fps));
+	int fading = 0;
+	int fade_frame = 0;
+	double fade_start = 0.0;
 	color_setting_t fade_start_interp;
 
-	r = signals_install_handlers();
+	/* Whether the current fade was planned, and the target it was
+	   planned for. The buffer for the frames of a plan is reused for
+	   each fade. The plan is only an optimization, so a failed
+	   allocation just leaves fades unplanned. */
+	int fade_planned = 0;
+	colorramp_key_t fade_plan_key;
+	color_setting_t *fade_plan_frames =
+		malloc(fade_frames*sizeof(color_setting_t));
+
+	r = eventloop_init();
 	if (r < 0) {
 		return r;
 	}
@@ -634,6 +905,15 @@ run_continual_mode(const location_provider_t *provider,
 	color_setting_t interp;
 	color_setting_reset(&interp);
 
+	/* Solar elevation over the current day */
+	solar_timeline_t timeline;
+	solar_timeline_init(&timeline);
+
+	/* Number of adjusted CRTCs, to print changes */
+	int crtc_active = 0;
+	int crtc_total = 0;
+	method->get_crtc_count(method_state, &crtc_active, &crtc_total);
+
 	location_t loc = { NAN, NAN };
 	int need_location = !scheme->use_time;
 	if (need_location) {
@@ -657,6 +937,26 @@ run_continual_mode(const location_provider_t *provider,
 		print_location(&loc);
 	}
 
+	/* Wait for caught signals, display changes, control commands and
+	   location updates. Only the fd of the adjustment method may
+	   change, so it is updated after the method handles changes. */
+	int signal_fd = signals_get_fd();
+	int method_fd = -1;
+	int loc_fd = -1;
+	if (need_location) {
+		/* Provider is dynamic if it has an fd. */
+		loc_fd = provider->get_fd(location_state);
+	}
+
+	r = eventloop_add_fd(signal_fd);
+	if (r == 0) {
+		r = eventloop_update_fd(
+			&method_fd, method->get_fd(method_state));
+	}
+	if (r == 0) r = eventloop_add_fd(loc_fd);
+	if (r == 0) r = eventloop_add_fd(control_get_fd());
+	if (r < 0) return -1;
+
 	if (verbose) {
 		printf(_("Color temperature: %uK\n"), interp.temperature);
 		printf(_("Brightness: %.2f\n"), interp.brightness);
@@ -695,39 +995,31 @@ run_continual_mode(const location_provider_t *provider,
 		prev_disabled = disabled;
 
 		/* Read timestamp */
-		double now;
+		double now, now_mono;
 		r = systemtime_get_time(&now);
+		if (r == 0) r = systemtime_get_monotonic(&now_mono);
 		if (r < 0) {
 			fputs(_("Unable to read system time.\n"), stderr);
 			return -1;
 		}
 
-		period_t period;
-		double transition_prog;
-		if (scheme->use_time) {
-			int time_offset = get_seconds_since_midnight(now);
-
-			period = get_period_from_time(scheme, time_offset);
-			transition_prog = get_transition_progress_from_time(
-				scheme, time_offset);
-		} else {
-			/* Current angular elevation of the sun */
-			double elevation = solar_elevation(
-				now, loc.lat, loc.lon);
+		if (simulate && now >= end_time) break;
 
-			period = get_period_from_elevation(scheme, elevation);
-			transition_prog =
-				get_transition_progress_from_elevation(
-					scheme, elevation);
-		}
+		/* Adjustment may be paused through the control socket */
+		double pause = control_get_pause(now_mono);
 
-		/* Use transition progress to get target color
-		   temperature. */
+		period_t period;
+		double transition_prog;
 		color_setting_t target_interp;
-		interpolate_transition_scheme(
-			scheme, transition_prog, &target_interp);
+		get_target_setting(scheme, &loc, &timeline, now, &period,
+				   &transition_prog, &target_interp);
+
+		/* Keep target of the scheme to find its next change,
+		   then apply overrides from the control socket. */
+		color_setting_t scheme_interp = target_interp;
+		control_apply_overrides(&target_interp);
 
-		if (disabled) {
+		if (disabled || pause > 0.0) {
 			period = PERIOD_NONE;
 			color_setting_reset(&target_interp);
 		}
@@ -753,40 +1045,79 @@ run_continual_mode(const location_provider_t *provider,
 		/* Start fade if the parameter differences are too big to apply
 		   instantly. */
 		if (use_fade) {
-			if ((fade_length == 0 &&
+			if ((!fading &&
 			     color_setting_diff_is_major(
 				     &interp,
 				     &target_interp)) ||
-			    (fade_length != 0 &&
+			    (fading &&
 			     color_setting_diff_is_major(
 				     &target_interp,
 				     &prev_target_interp))) {
-				fade_length = FADE_LENGTH;
-				fade_time = 0;
+				fading = 1;
+				fade_frame = 0;
+				fade_start = now_mono;
 				fade_start_interp = interp;
+				fade_planned = 0;
 			}
 		}
 
 		/* Handle ongoing fade */
-		if (fade_length != 0) {
-			fade_time += 1;
-			double frac = fade_time / (double)fade_length;
-			double alpha = CLAMP(0.0, ease_fade(frac), 1.0);
-
-			interpolate_color_settings(
-				&fade_start_interp, &target_interp, alpha,
-				&interp);
-
-			if (fade_time > fade_length) {
-				fade_time = 0;
-				fade_length = 0;
+		if (fading) {
+			/* Show the frame that is due now, skipping frames
+			   if updates are slow so that the fade keeps its
+			   duration. Frame k is due (k-1)/fps after the start,
+			   and it is shown if the loop wakes up less than
+			   half a frame early, e.g. at a vertical blank. */
+			int frame = lround(
+				(now_mono - fade_start)*fade_fps) + 1;
+			fade_frame = MAX(fade_frame, frame);
+
+			/* Plan the fade when it starts, unless the target
+			   moves before the fade is over, as it does during
+			   a transition. Every frame is different then, and
+			   frames are generated as they are shown. If the
+			   target moves after all, the plan is dropped. */
+			colorramp_key_t target_key;
+			colorramp_cache_key(&target_key, 0, &target_interp,
+					    NULL);
+			if (!fade_planned) {
+				colorramp_key_t scheme_key;
+				colorramp_cache_key(&scheme_key, 0,
+						    &scheme_interp, NULL);
+				int moving = !disabled && pause <= 0.0 &&
+					target_changes_at(
+						scheme, &loc, &timeline,
+						now + fade_duration,
+						&scheme_key);
+				plan_fade(&fade_start_interp, &target_interp,
+					  fade_frame, fade_frames,
+					  moving ? NULL : fade_plan_frames);
+				fade_plan_key = target_key;
+				fade_planned = 1;
+			} else if (!colorramp_cache_key_equal(
+					   &target_key, &fade_plan_key)) {
+				colorramp_cache_plan(NULL, 0);
+				fade_plan_key = target_key;
+			}
+
+			if (fade_frame < fade_frames) {
+				get_fade_frame(&fade_start_interp,
+					       &target_interp, fade_frame,
+					       fade_frames, &interp);
+			} else {
+				interp = target_interp;
+				fading = 0;
 			}
 		} else {
+			if (fade_planned) {
+				colorramp_cache_plan(NULL, 0);
+				fade_planned = 0;
+			}
 			interp = target_interp;
 		}
 
 		/* Break loop when done and final fade is over */
-		if (done && fade_length == 0) break;
+		if (done && !fading) break;
 
 		if (verbose) {
 			if (prev_target_interp.temperature !=
@@ -810,82 +1141,273 @@ run_continual_mode(const location_provider_t *provider,
 			return -1;
 		}
 
-		/* Save period and target color setting as previous */
-		prev_period = period;
-		prev_target_interp = target_interp;
+		control_set_status(period, transition_prog, &interp,
+				   disabled);
 
-		/* Sleep length depends on whether a fade is ongoing. */
-		int delay = SLEEP_DURATION;
-		if (fade_length != 0) {
-			delay = SLEEP_DURATION_SHORT;
+		if (simulate && memcmp(&interp, &printed_interp,
+				       sizeof(color_setting_t)) != 0) {
+			printf("%.2f %u %.2f\n", now, interp.temperature,
+			       interp.brightness);
+			printed_interp = interp;
 		}
 
-		/* Update location. */
-		int loc_fd = -1;
-		if (need_location) {
-			loc_fd = provider->get_fd(location_state);
+		/* Apply setting to displays that were added or changed */
+		r = method->handle(method_state, &interp, preserve_gamma);
+		if (r < 0) {
+			fputs(_("Unable to handle display changes.\n"),
+			      stderr);
+			return -1;
 		}
 
-		if (loc_fd >= 0) {
-			/* Provider is dynamic. */
-			struct pollfd pollfds[1];
-			pollfds[0].fd = loc_fd;
-			pollfds[0].events = POLLIN;
-			int r = poll(pollfds, 1, delay);
-			if (r < 0) {
-				if (errno == EINTR) continue;
-				perror("poll");
-				fputs(_("Unable to get location"
-					" from provider.\n"), stderr);
-				return -1;
-			} else if (r == 0) {
-				continue;
+		r = eventloop_update_fd(
+			&method_fd, method->get_fd(method_state));
+		if (r < 0) return -1;
+
+		if (verbose) {
+			int active, total;
+			r = method->get_crtc_count(
+				method_state, &active, &total);
+			if (r == 0 && (active != crtc_active ||
+				       total != crtc_total)) {
+				printf(_("Active CRTCs: %i of %i\n"),
+				       active, total);
+				crtc_active = active;
+				crtc_total = total;
 			}
+		}
+
+		/* Save period and target color setting as previous */
+		prev_period = period;
+		prev_target_interp = target_interp;
 
-			/* Get new location and availability
-			   information. */
-			location_t new_loc;
-			int new_available;
-			r = provider->handle(
-				location_state, &new_loc,
-				&new_available);
+		/* Time to wait depends on whether a fade is ongoing.
+		   Otherwise wait until the target setting changes. */
+		double timeout;
+		if (fading) {
+			/* Wake up when the next frame is due */
+			double next = fade_start + fade_frame/fade_fps;
+			r = systemtime_get_monotonic(&now_mono);
 			if (r < 0) {
-				fputs(_("Unable to get location"
-					" from provider.\n"), stderr);
+				fputs(_("Unable to read system time.\n"),
+				      stderr);
 				return -1;
 			}
+			timeout = MAX(0.0, next - now_mono);
+		} else if (disabled) {
+			timeout = SLEEP_DURATION_MAX / 1000.0;
+		} else if (pause > 0.0) {
+			/* Wake up when the pause ends */
+			timeout = pause;
+		} else {
+			timeout = get_next_change_delay(
+				scheme, &loc, &timeline, now,
+				&scheme_interp) / 1000.0;
+		}
 
-			if (!new_available &&
-			    new_available != location_available) {
-				fputs(_("Location is temporarily"
-				        " unavailable; Using previous"
-					" location until it becomes"
-					" available...\n"), stderr);
-			}
+		/* Do not wait past the end of the simulation */
+		if (simulate) timeout = MIN(timeout, MAX(0.0, end_time - now));
 
-			if (new_available &&
-			    (new_loc.lat != loc.lat ||
-			     new_loc.lon != loc.lon ||
-			     new_available != location_available)) {
-				loc = new_loc;
-				print_location(&loc);
-			}
+		/* Wait for timeout or events. Display changes and
+		   commands take effect on the next iteration. */
+		r = eventloop_wait(timeout);
+		if (r < 0) return -1;
 
-			location_available = new_available;
+		/* Recompute right away after the clock was set or the
+		   system resumed from suspend. */
+		if (eventloop_clock_changed() && verbose) {
+			printf(_("System clock changed.\n"));
+		}
 
-			if (!location_is_valid(&loc)) {
-				fputs(_("Invalid location returned"
-					" from provider.\n"), stderr);
-				return -1;
-			}
-		} else {
-			systemtime_msleep(delay);
+		if (r == 0) continue;
+
+		if (eventloop_is_ready(signal_fd)) signals_handle_fd();
+		control_handle();
+
+		if (!eventloop_is_ready(loc_fd)) continue;
+
+		/* Get new location and availability information. */
+		location_t new_loc;
+		int new_available;
+		r = provider->handle(location_state, &new_loc, &new_available);
+		if (r < 0) {
+			fputs(_("Unable to get location"
+				" from provider.\n"), stderr);
+			return -1;
+		}
+
+		if (!new_available && new_available != location_available) {
+			fputs(_("Location is temporarily unavailable;"
+				" Using previous location until it becomes"
+				" available...\n"), stderr);
+		}
+
+		if (new_available &&
+		    (new_loc.lat != loc.lat ||
+		     new_loc.lon != loc.lon ||
+		     new_available != location_available)) {
+			loc = new_loc;
+			print_location(&loc);
+		}
+
+		location_available = new_available;
+
+		if (!location_is_valid(&loc)) {
+			fputs(_("Invalid location returned"
+				" from provider.\n"), stderr);
+			return -1;
 		}
 	}
 
+	eventloop_free();
+	colorramp_cache_plan(NULL, 0);
+	free(fade_plan_frames);
+
 	/* Restore saved gamma ramps */
 	method->restore(method_state);
 
+	if (verbose) {
+		colorramp_cache_stats_t stats;
+		colorramp_cache_get_stats(&stats);
+		printf(_("Ramp cache: %lu hits, %lu misses,"
+			 " %lu updates skipped\n"),
+		       stats.hits, stats.misses, stats.elided);
+	}
+
+	return 0;
+}
+
+/* Evaluate transition scheme for batch records. Called from worker
+   threads of the batch pool. */
+static void
+batch_eval(const batch_record_t *records, batch_result_t *results,
+	   int count, void *data)
+{
+	const transition_scheme_t *scheme = data;
+
+	if (scheme->use_time) {
+		for (int i = 0; i < count; i++) {
+			int time_offset = lookup_seconds_since_midnight(
+				(time_t)records[i].date);
+			results[i].period = get_period_from_time(
+				scheme, time_offset);
+			results[i].progress = get_transition_progress_from_time(
+				scheme, time_offset);
+		}
+	} else {
+		double dates[BATCH_CHUNK_RECORDS];
+		double elevations[BATCH_CHUNK_RECORDS];
+		for (int i = 0; i < count; i++) dates[i] = records[i].date;
+
+		/* Evaluate runs of records at the same location together */
+		int start = 0;
+		while (start < count) {
+			int end = start + 1;
+			while (end < count &&
+			       records[end].lat == records[start].lat &&
+			       records[end].lon == records[start].lon) {
+				end += 1;
+			}
+
+			solar_elevation_batch(
+				&dates[start], end - start,
+				records[start].lat, records[start].lon,
+				&elevations[start]);
+			start = end;
+		}
+
+		for (int i = 0; i < count; i++) {
+			results[i].period = get_period_from_elevation(
+				scheme, elevations[i]);
+			results[i].progress =
+				get_transition_progress_from_elevation(
+					scheme, elevations[i]);
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		interpolate_transition_scheme(
+			scheme, results[i].progress, &results[i].setting);
+	}
+}
+
+/* Run batch mode
+   Reads records of location and time from the given file (or standard
+   input if path is `-') and prints the color setting for each. */
+static int
+run_batch_mode(const transition_scheme_t *scheme, const char *path)
+{
+	FILE *f = stdin;
+	if (strcmp(path, "-") != 0) {
+		f = fopen(path, "r");
+		if (f == NULL) {
+			perror("fopen");
+			fprintf(stderr, _("Unable to open batch file `%s'.\n"),
+				path);
+			return -1;
+		}
+	}
+
+	int r = batch_run(f, stdout, batch_eval, (void *)scheme);
+
+	if (f != stdin) fclose(f);
+
+	return r;
+}
+
+/* Options needed to reload the config file from the control socket. */
+typedef struct {
+	/* Options in use, whose scheme is replaced on reload. */
+	options_t *options;
+	/* Options as given on the command line. */
+	options_t cli_options;
+	const gamma_method_t *gamma_methods;
+	const location_provider_t *location_providers;
+} reload_data_t;
+
+/* Reload transition scheme from the config file. Options given on the
+   command line keep precedence. The running scheme is kept if the new
+   one is not valid. */
+static int
+reload_config(void *data)
+{
+	reload_data_t *reload = data;
+	options_t options = reload->cli_options;
+
+	config_ini_state_t config_state;
+	int r = config_ini_init(&config_state, options.config_filepath);
+	if (r < 0) {
+		fputs("Unable to load config file.\n", stderr);
+		return -1;
+	}
+
+	r = options_parse_config_file(
+		&options, &config_state, reload->gamma_methods,
+		reload->location_providers);
+	config_ini_free(&config_state);
+
+	/* The control socket is already open. */
+	free(options.control_socket);
+	if (r < 0) return -1;
+
+	options_set_defaults(&options);
+
+	transition_scheme_t *scheme = &options.scheme;
+	r = scheme_check(scheme, PROGRAM_MODE_CONTINUAL);
+	if (r < 0) return -1;
+
+	/* The location provider is only running for solar elevation. */
+	if (scheme->use_time != reload->options->scheme.use_time) {
+		fputs(_("Switching between dawn/dusk times and solar"
+			" elevation requires a restart.\n"), stderr);
+		return -1;
+	}
+
+	reload->options->scheme = *scheme;
+
+	if (reload->options->verbose) {
+		printf(_("Reloaded configuration.\n"));
+	}
+
 	return 0;
 }
 
@@ -949,6 +1471,21 @@ main(int argc, char *argv[])
 	options_parse_args(
 		&options, argc, argv, gamma_methods, location_providers);
 
+	/* Keep command line options for reloading the config file. */
+	reload_data_t reload_data;
+	reload_data.options = &options;
+	reload_data.cli_options = options;
+	reload_data.gamma_methods = gamma_methods;
+	reload_data.location_providers = location_providers;
+	if (options.config_filepath != NULL) {
+		reload_data.cli_options.config_filepath =
+			strdup(options.config_filepath);
+		if (reload_data.cli_options.config_filepath == NULL) {
+			perror("strdup");
+			exit(EXIT_FAILURE);
+		}
+	}
+
 	/* Load settings from config file. */
 	config_ini_state_t config_state;
 	r = config_ini_init(&config_state, options.config_filepath);
@@ -959,41 +1496,34 @@ main(int argc, char *argv[])
 
 	free(options.config_filepath);
 
-	options_parse_config_file(
+	r = options_parse_config_file(
 		&options, &config_state, gamma_methods, location_providers);
+	if (r < 0) exit(EXIT_FAILURE);
 
 	options_set_defaults(&options);
 
-	if (options.scheme.dawn.start >= 0 || options.scheme.dawn.end >= 0 ||
-	    options.scheme.dusk.start >= 0 || options.scheme.dusk.end >= 0) {
-		if (options.scheme.dawn.start < 0 ||
-		    options.scheme.dawn.end < 0 ||
-		    options.scheme.dusk.start < 0 ||
-		    options.scheme.dusk.end < 0) {
-			fputs(_("Partitial time-configuration not"
-				" supported!\n"), stderr);
-			exit(EXIT_FAILURE);
-		}
-
-		if (options.scheme.dawn.start > options.scheme.dawn.end ||
-		    options.scheme.dawn.end > options.scheme.dusk.start ||
-		    options.scheme.dusk.start > options.scheme.dusk.end) {
-			fputs(_("Invalid dawn/dusk time configuration!\n"),
-			      stderr);
-			exit(EXIT_FAILURE);
-		}
+	r = scheme_check(&options.scheme, options.mode);
+	if (r < 0) exit(EXIT_FAILURE);
 
-		options.scheme.use_time = 1;
+	/* Install signal handlers for continual mode. Where the signals
+	   are read from a signalfd they are blocked, so this must happen
+	   before location providers and adjustment methods start threads,
+	   which inherit the signal mask. */
+	if (options.mode == PROGRAM_MODE_CONTINUAL) {
+		r = signals_install_handlers();
+		if (r < 0) exit(EXIT_FAILURE);
 	}
 
 	/* Initialize location provider if needed. If provider is NULL
 	   try all providers until one that works is found. */
 	location_state_t *location_state;
 
-	/* Location is not needed for reset mode and manual mode. */
+	/* Location is not needed for reset mode and manual mode. Batch
+	   mode reads locations from its input. */
 	int need_location =
 		options.mode != PROGRAM_MODE_RESET &&
 		options.mode != PROGRAM_MODE_MANUAL &&
+		options.mode != PROGRAM_MODE_BATCH &&
 		!options.scheme.use_time;
 	if (need_location) {
 		if (options.provider != NULL) {
@@ -1034,14 +1564,6 @@ main(int argc, char *argv[])
 			}
 		}
 
-		/* Solar elevations */
-		if (options.scheme.high < options.scheme.low) {
-			fprintf(stderr,
-				_("High transition elevation cannot be lower than"
-				  " the low transition elevation.\n"));
-			exit(EXIT_FAILURE);
-		}
-
 		if (options.verbose) {
 			/* TRANSLATORS: Append degree symbols if possible. */
 			printf(_("Solar elevations: day above %.1f, night below %.1f\n"),
@@ -1056,17 +1578,6 @@ main(int argc, char *argv[])
 			       options.scheme.day.temperature,
 			       options.scheme.night.temperature);
 		}
-
-		/* Color temperature */
-		if (options.scheme.day.temperature < MIN_TEMP ||
-		    options.scheme.day.temperature > MAX_TEMP ||
-		    options.scheme.night.temperature < MIN_TEMP ||
-		    options.scheme.night.temperature > MAX_TEMP) {
-			fprintf(stderr,
-				_("Temperature must be between %uK and %uK.\n"),
-				MIN_TEMP, MAX_TEMP);
-			exit(EXIT_FAILURE);
-		}
 	}
 
 	if (options.mode == PROGRAM_MODE_MANUAL) {
@@ -1080,14 +1591,20 @@ main(int argc, char *argv[])
 		}
 	}
 
-	/* Brightness */
-	if (options.scheme.day.brightness < MIN_BRIGHTNESS ||
-	    options.scheme.day.brightness > MAX_BRIGHTNESS ||
-	    options.scheme.night.brightness < MIN_BRIGHTNESS ||
-	    options.scheme.night.brightness > MAX_BRIGHTNESS) {
+	/* Fade */
+	if (options.fade_duration < MIN_FADE_DURATION ||
+	    options.fade_duration > MAX_FADE_DURATION) {
 		fprintf(stderr,
-			_("Brightness values must be between %.1f and %.1f.\n"),
-			MIN_BRIGHTNESS, MAX_BRIGHTNESS);
+			_("Fade duration must be between %.1f and %.1f"
+			  " seconds.\n"),
+			MIN_FADE_DURATION, MAX_FADE_DURATION);
+		exit(EXIT_FAILURE);
+	}
+	if (options.fade_fps < MIN_FADE_FPS ||
+	    options.fade_fps > MAX_FADE_FPS) {
+		fprintf(stderr,
+			_("Fade frame rate must be between %.0f and %.0f.\n"),
+			MIN_FADE_FPS, MAX_FADE_FPS);
 		exit(EXIT_FAILURE);
 	}
 
@@ -1097,15 +1614,6 @@ main(int argc, char *argv[])
 		       options.scheme.night.brightness);
 	}
 
-	/* Gamma */
-	if (!gamma_is_valid(options.scheme.day.gamma) ||
-	    !gamma_is_valid(options.scheme.night.gamma)) {
-		fprintf(stderr,
-			_("Gamma value must be between %.1f and %.1f.\n"),
-			MIN_GAMMA, MAX_GAMMA);
-		exit(EXIT_FAILURE);
-	}
-
 	if (options.verbose) {
 		/* TRANSLATORS: The string in parenthesis is either
 		   Daytime or Night (translated). */
@@ -1125,13 +1633,20 @@ main(int argc, char *argv[])
 	   try all methods until one that works is found. */
 	gamma_state_t *method_state;
 
-	/* Gamma adjustment not needed for print mode */
-	if (options.mode != PROGRAM_MODE_PRINT) {
+	/* Gamma adjustment not needed for print mode and batch mode */
+	if (options.mode != PROGRAM_MODE_PRINT &&
+	    options.mode != PROGRAM_MODE_BATCH) {
+		/* Current ramps are restored at exit in continual mode,
+		   and preserved unless reset mode is used. */
+		int save_ramps = options.mode == PROGRAM_MODE_CONTINUAL ||
+			(options.preserve_gamma &&
+			 options.mode != PROGRAM_MODE_RESET);
+
 		if (options.method != NULL) {
 			/* Use method specified on command line. */
 			r = method_try_start(
 				options.method, &method_state, &config_state,
-				options.method_args);
+				options.method_args, save_ramps);
 			if (r < 0) exit(EXIT_FAILURE);
 		} else {
 			/* Try all methods, use the first that works. */
@@ -1140,7 +1655,8 @@ main(int argc, char *argv[])
 				if (!m->autostart) continue;
 
 				r = method_try_start(
-					m, &method_state, &config_state, NULL);
+					m, &method_state, &config_state, NULL,
+					save_ramps);
 				if (r < 0) {
 					fputs(_("Trying next method...\n"), stderr);
 					continue;
@@ -1158,6 +1674,16 @@ main(int argc, char *argv[])
 				exit(EXIT_FAILURE);
 			}
 		}
+
+		if (options.verbose) {
+			int active, total;
+			r = options.method->get_crtc_count(
+				method_state, &active, &total);
+			if (r == 0) {
+				printf(_("Active CRTCs: %i of %i\n"),
+				       active, total);
+			}
+		}
 	}
 
 	config_ini_free(&config_state);
@@ -1302,27 +1828,54 @@ main(int argc, char *argv[])
 		}
 	}
 	break;
+	case PROGRAM_MODE_BATCH:
+	{
+		r = run_batch_mode(scheme, options.batch_filepath);
+		if (r < 0) exit(EXIT_FAILURE);
+	}
+	break;
 	case PROGRAM_MODE_CONTINUAL:
 	{
+		if (!isnan(options.sim_start)) {
+			systemtime_set_virtual(
+				options.sim_start, options.sim_speed);
+		}
+
+		if (options.control_socket != NULL) {
+			r = control_init(options.control_socket,
+					 reload_config, &reload_data);
+			if (r < 0) {
+				options.method->free(method_state);
+				exit(EXIT_FAILURE);
+			}
+		}
+
 		r = run_continual_mode(
 			options.provider, location_state, scheme,
 			options.method, method_state,
-			options.use_fade, options.preserve_gamma,
-			options.verbose);
+			options.use_fade, options.fade_duration,
+			options.fade_fps, options.preserve_gamma,
+			options.sim_end, options.verbose);
+		control_free();
 		if (r < 0) exit(EXIT_FAILURE);
 	}
 	break;
 	}
 
 	/* Clean up gamma adjustment state */
-	if (options.mode != PROGRAM_MODE_PRINT) {
+	if (options.mode != PROGRAM_MODE_PRINT &&
+	    options.mode != PROGRAM_MODE_BATCH) {
 		options.method->free(method_state);
 	}
+	colorramp_cache_free();
 
 	/* Clean up location provider state */
 	if (need_location) {
 		options.provider->free(location_state);
 	}
 
+	free(options.control_socket);
+	free(reload_data.cli_options.config_filepath);
+
 	return EXIT_SUCCESS;
 }
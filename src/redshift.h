@@ -26,6 +26,12 @@
 /* The color temperature when no adjustment is applied. */
 #define NEUTRAL_TEMP  6500
 
+/* Bounds for color settings. */
+#define MIN_TEMP   1000
+#define MAX_TEMP  25000
+#define MIN_BRIGHTNESS  0.1
+#define MAX_BRIGHTNESS  1.0
+
 
 /* Location */
 typedef struct {
@@ -54,7 +60,8 @@ typedef enum {
 	PROGRAM_MODE_ONE_SHOT,
 	PROGRAM_MODE_PRINT,
 	PROGRAM_MODE_RESET,
-	PROGRAM_MODE_MANUAL
+	PROGRAM_MODE_MANUAL,
+	PROGRAM_MODE_BATCH
 } program_mode_t;
 
 /* Time range.
@@ -82,7 +89,7 @@ typedef struct {
 typedef struct gamma_state gamma_state_t;
 
 typedef int gamma_method_init_func(gamma_state_t **state);
-typedef int gamma_method_start_func(gamma_state_t *state);
+typedef int gamma_method_start_func(gamma_state_t *state, int save_ramps);
 typedef void gamma_method_free_func(gamma_state_t *state);
 typedef void gamma_method_print_help_func(FILE *f);
 typedef int gamma_method_set_option_func(gamma_state_t *state, const char *key,
@@ -90,6 +97,11 @@ typedef int gamma_method_set_option_func(gamma_state_t *state, const char *key,
 typedef void gamma_method_restore_func(gamma_state_t *state);
 typedef int gamma_method_set_temperature_func(
 	gamma_state_t *state, const color_setting_t *setting, int preserve);
+typedef int gamma_method_get_fd_func(gamma_state_t *state);
+typedef int gamma_method_handle_func(
+	gamma_state_t *state, const color_setting_t *setting, int preserve);
+typedef int gamma_method_get_crtc_count_func(
+	gamma_state_t *state, int *active, int *total);
 
 typedef struct {
 	char *name;
@@ -99,7 +111,9 @@ typedef struct {
 
 	/* Initialize state. Options can be set between init and start. */
 	gamma_method_init_func *init;
-	/* Allocate storage and make connections that depend on options. */
+	/* Allocate storage and make connections that depend on options.
+	   Current gamma ramps are only saved if save_ramps is set, i.e.
+	   when they will be restored or preserved. */
 	gamma_method_start_func *start;
 	/* Free all allocated storage and close connections. */
 	gamma_method_free_func *free;
@@ -113,6 +127,17 @@ typedef struct {
 	gamma_method_restore_func *restore;
 	/* Set a specific color temperature. */
 	gamma_method_set_temperature_func *set_temperature;
+
+	/* Listen and handle display configuration changes. Displays
+	   that were added or changed are set to the given setting.
+	   get_fd returns the fd to wait for, or -1 if there is none. The
+	   fd may only change in a call to handle. */
+	gamma_method_get_fd_func *get_fd;
+	gamma_method_handle_func *handle;
+
+	/* Get number of CRTCs that are adjusted and the total number of
+	   CRTCs. Return -1 if the method has no notion of CRTCs. */
+	gamma_method_get_crtc_count_func *get_crtc_count;
 } gamma_method_t;
 
 
@@ -144,7 +169,9 @@ typedef struct {
 	/* Set an option key, value-pair. */
 	location_provider_set_option_func *set_option;
 
-	/* Listen and handle location updates. */
+	/* Listen and handle location updates. get_fd returns the fd to
+	   wait for, or -1 if there is none. The fd must stay the same
+	   until the provider is freed. */
 	location_provider_get_fd_func *get_fd;
 	location_provider_handle_func *handle;
 } location_provider_t;
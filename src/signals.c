@@ -23,11 +23,17 @@
 #endif
 
 #include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
 #if defined(HAVE_SIGNAL_H) && !defined(__WIN32__)
 # include <signal.h>
 #endif
+#ifdef HAVE_SYS_SIGNALFD_H
+# include <sys/signalfd.h>
+#endif
 
 #include "signals.h"
+#include "pipeutils.h"
 
 
 #if defined(HAVE_SIGNAL_H) && !defined(__WIN32__)
@@ -35,12 +41,32 @@
 volatile sig_atomic_t exiting = 0;
 volatile sig_atomic_t disable = 0;
 
+/* Pipe that is signaled when a signal is caught, so that the main loop
+   can wake up from poll. */
+static int signal_pipe[2] = { -1, -1 };
+
+#ifdef HAVE_SYS_SIGNALFD_H
+/* Where available, the exit and disable signals are blocked and read
+   from a signalfd instead of being caught by handlers. */
+static int signal_fd = -1;
+static sigset_t signal_fd_mask;
+#endif
+
+
+static void
+wake_main_loop(void)
+{
+	int saved_errno = errno;
+	if (signal_pipe[1] >= 0) pipeutils_signal(signal_pipe[1]);
+	errno = saved_errno;
+}
 
 /* Signal handler for exit signals */
 static void
 sigexit(int signo)
 {
 	exiting = 1;
+	wake_main_loop();
 }
 
 /* Signal handler for disable signal */
@@ -48,8 +74,40 @@ static void
 sigdisable(int signo)
 {
 	disable = 1;
+	wake_main_loop();
 }
 
+#ifdef HAVE_SYS_SIGNALFD_H
+/* Block exit and disable signals and create signalfd to read them.
+   Return -1 if the signalfd could not be created. */
+static int
+install_signal_fd(void)
+{
+	if (signal_fd >= 0) return 0;
+
+	sigemptyset(&signal_fd_mask);
+	sigaddset(&signal_fd_mask, SIGINT);
+	sigaddset(&signal_fd_mask, SIGTERM);
+	sigaddset(&signal_fd_mask, SIGUSR1);
+
+	int r = sigprocmask(SIG_BLOCK, &signal_fd_mask, NULL);
+	if (r < 0) {
+		perror("sigprocmask");
+		return -1;
+	}
+
+	signal_fd = signalfd(-1, &signal_fd_mask,
+			     SFD_NONBLOCK | SFD_CLOEXEC);
+	if (signal_fd < 0) {
+		perror("signalfd");
+		sigprocmask(SIG_UNBLOCK, &signal_fd_mask, NULL);
+		return -1;
+	}
+
+	return 0;
+}
+#endif
+
 #else /* ! HAVE_SIGNAL_H || __WIN32__ */
 
 int disable = 0;
@@ -67,6 +125,28 @@ signals_install_handlers(void)
 	int r;
 	sigemptyset(&sigset);
 
+	/* Ignore CHLD signal. This causes child processes
+	   (hooks) to be reaped automatically. */
+	sigact.sa_handler = SIG_IGN;
+	sigact.sa_mask = sigset;
+	sigact.sa_flags = 0;
+
+	r = sigaction(SIGCHLD, &sigact, NULL);
+	if (r < 0) {
+		perror("sigaction");
+		return -1;
+	}
+
+#ifdef HAVE_SYS_SIGNALFD_H
+	r = install_signal_fd();
+	if (r == 0) return 0;
+#endif
+
+	if (signal_pipe[0] < 0) {
+		r = pipeutils_create_nonblocking(signal_pipe);
+		if (r < 0) return -1;
+	}
+
 	/* Install signal handler for INT and TERM signals */
 	sigact.sa_handler = sigexit;
 	sigact.sa_mask = sigset;
@@ -94,19 +174,57 @@ signals_install_handlers(void)
 		perror("sigaction");
 		return -1;
 	}
+#endif /* HAVE_SIGNAL_H && ! __WIN32__ */
 
-	/* Ignore CHLD signal. This causes child processes
-	   (hooks) to be reaped automatically. */
-	sigact.sa_handler = SIG_IGN;
-	sigact.sa_mask = sigset;
-	sigact.sa_flags = 0;
+	return 0;
+}
 
-	r = sigaction(SIGCHLD, &sigact, NULL);
-	if (r < 0) {
-		perror("sigaction");
-		return -1;
+/* Return file descriptor that becomes readable when a signal has been
+   caught, or -1 if not available. Call signals_handle_fd() when it
+   is readable. */
+int
+signals_get_fd(void)
+{
+#if defined(HAVE_SIGNAL_H) && !defined(__WIN32__)
+# ifdef HAVE_SYS_SIGNALFD_H
+	if (signal_fd >= 0) return signal_fd;
+# endif
+	return signal_pipe[0];
+#else
+	return -1;
+#endif
+}
+
+void
+signals_handle_fd(void)
+{
+#if defined(HAVE_SIGNAL_H) && !defined(__WIN32__)
+# ifdef HAVE_SYS_SIGNALFD_H
+	if (signal_fd >= 0) {
+		struct signalfd_siginfo info;
+		while (read(signal_fd, &info, sizeof(info)) ==
+		       sizeof(info)) {
+			if (info.ssi_signo == SIGUSR1) {
+				disable = 1;
+			} else {
+				exiting = 1;
+			}
+		}
+		return;
 	}
-#endif /* HAVE_SIGNAL_H && ! __WIN32__ */
+# endif
+	pipeutils_handle_signal(signal_pipe[0]);
+#endif
+}
 
-	return 0;
+/* Unblock the signals that are read from the signalfd. Child processes
+   inherit the signal mask, so this is called before exec. */
+void
+signals_unblock(void)
+{
+#ifdef HAVE_SYS_SIGNALFD_H
+	if (signal_fd >= 0) {
+		sigprocmask(SIG_UNBLOCK, &signal_fd_mask, NULL);
+	}
+#endif
 }
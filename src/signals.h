@@ -33,6 +33,9 @@ extern int disable;
 
 
 int signals_install_handlers(void);
+int signals_get_fd(void);
+void signals_handle_fd(void);
+void signals_unblock(void);
 
 
 #endif /* REDSHIFT_SIGNALS_H */
@@ -31,6 +31,8 @@
 #define RAD(x)  ((x)*(M_PI/180))
 #define DEG(x)  ((x)*(180/M_PI))
 
+#define CLAMP(lo,mid,up)  (((lo) > (mid)) ? (lo) : (((mid) < (up)) ? (mid) : (up)))
+
 
 /* Angels of various times of day. */
 static const double time_angle[] = {
@@ -296,6 +298,75 @@ solar_elevation(double date, double lat, double lon)
 	return DEG(solar_elevation_from_time(jcent_from_jd(jd), lat, lon));
 }
 
+/* Quadratic interpolation through values at u = 0, 0.5 and 1. */
+static void
+quadratic_fit(double f0, double f1, double f2, double *c)
+{
+	c[0] = f0;
+	c[1] = -3*f0 + 4*f1 - f2;
+	c[2] = 2*f0 - 4*f1 + 2*f2;
+}
+
+/* Solar angular elevation at the given location for many times.
+   Equation of time and declination change slowly, so they are only
+   evaluated three times per day and interpolated quadratically
+   in between. This is most efficient when dates are sorted.
+   dates: Seconds since unix epoch
+   n: Number of dates
+   lat: Latitude of location
+   lon: Longitude of location
+   out: Solar angular elevation in degrees for each date */
+void
+solar_elevation_batch(
+	const double *dates, size_t n, double lat, double lon, double *out)
+{
+	double sin_lat = sin(RAD(lat));
+	double cos_lat = cos(RAD(lat));
+
+	/* Interpolation of equation of time, and sine and cosine
+	   of declination over the current day. */
+	double day = NAN;
+	double eq_c[3] = { 0 }, sin_decl_c[3] = { 0 }, cos_decl_c[3] = { 0 };
+
+	for (size_t i = 0; i < n; i++) {
+		double jd = jd_from_epoch(dates[i]);
+		if (!isfinite(jd)) {
+			out[i] = solar_elevation(dates[i], lat, lon);
+			continue;
+		}
+
+		double d = floor(jd);
+		if (d != day) {
+			double eq[3], sin_decl[3], cos_decl[3];
+			for (int k = 0; k < 3; k++) {
+				double t = jcent_from_jd(d + 0.5*k);
+				double decl = solar_declination(t);
+				eq[k] = equation_of_time(t);
+				sin_decl[k] = sin(decl);
+				cos_decl[k] = cos(decl);
+			}
+			quadratic_fit(eq[0], eq[1], eq[2], eq_c);
+			quadratic_fit(sin_decl[0], sin_decl[1], sin_decl[2],
+				      sin_decl_c);
+			quadratic_fit(cos_decl[0], cos_decl[1], cos_decl[2],
+				      cos_decl_c);
+			day = d;
+		}
+
+		double u = jd - d;
+		double eq_time = eq_c[0] + u*(eq_c[1] + u*eq_c[2]);
+		double sd = sin_decl_c[0] + u*(sin_decl_c[1] + u*sin_decl_c[2]);
+		double cd = cos_decl_c[0] + u*(cos_decl_c[1] + u*cos_decl_c[2]);
+
+		/* Minutes from midnight */
+		double offset = (jd - round(jd) - 0.5)*1440.0;
+		double ha = RAD((720 - offset - eq_time)/4 - lon);
+
+		double x = cos(ha)*cos_lat*cd + sin_lat*sd;
+		out[i] = DEG(asin(CLAMP(-1.0, x, 1.0)));
+	}
+}
+
 void
 solar_table_fill(double date, double lat, double lon, double *table)
 {
@@ -323,3 +394,96 @@ solar_table_fill(double date, double lat, double lon, double *table)
 		table[i] = epoch_from_jd(jdn - 0.5 + offset/1440.0);
 	}
 }
+
+
+/* Length of solar timeline in seconds. */
+#define TIMELINE_LENGTH  86400.0
+#define TIMELINE_SEGMENT_LENGTH  (TIMELINE_LENGTH/SOLAR_TIMELINE_SEGMENTS)
+/* Timeline starts this many seconds before the time that it is built
+   for, so that looking a bit ahead and then back does not rebuild it. */
+#define TIMELINE_MARGIN  (2*3600.0)
+
+/* Mark timeline as not built. */
+void
+solar_timeline_init(solar_timeline_t *timeline)
+{
+	timeline->valid = 0;
+}
+
+/* Fit Chebyshev polynomials to the solar elevation over each segment
+   of a day starting at start. */
+static void
+solar_timeline_build(
+	solar_timeline_t *timeline, double start, double lat, double lon)
+{
+	const int n = SOLAR_TIMELINE_DEGREE+1;
+
+	timeline->valid = 1;
+	timeline->start = start;
+	timeline->lat = lat;
+	timeline->lon = lon;
+
+	/* Sample each segment at its Chebyshev nodes */
+	double dates[SOLAR_TIMELINE_SEGMENTS][SOLAR_TIMELINE_DEGREE+1];
+	double samples[SOLAR_TIMELINE_SEGMENTS][SOLAR_TIMELINE_DEGREE+1];
+	for (int s = 0; s < SOLAR_TIMELINE_SEGMENTS; s++) {
+		double mid = start + (s + 0.5)*TIMELINE_SEGMENT_LENGTH;
+		double half = TIMELINE_SEGMENT_LENGTH/2;
+		for (int k = 0; k < n; k++) {
+			double x = cos(M_PI*(k + 0.5)/n);
+			dates[s][k] = mid + x*half;
+		}
+	}
+
+	solar_elevation_batch(&dates[0][0], SOLAR_TIMELINE_SEGMENTS*n,
+			      lat, lon, &samples[0][0]);
+
+	for (int s = 0; s < SOLAR_TIMELINE_SEGMENTS; s++) {
+		const double *values = samples[s];
+		for (int j = 0; j < n; j++) {
+			double sum = 0.0;
+			for (int k = 0; k < n; k++) {
+				sum += values[k]*cos(M_PI*j*(k + 0.5)/n);
+			}
+			timeline->coeffs[s][j] = (j == 0 ? 1.0 : 2.0)*sum/n;
+		}
+	}
+}
+
+/* Solar angular elevation at the given location and time, evaluated
+   from the timeline. The timeline is rebuilt when the location changes
+   or the time is outside the day that it covers.
+   date: Seconds since unix epoch
+   lat: Latitude of location
+   lon: Longitude of location
+   Return: Solar angular elevation in degrees */
+double
+solar_timeline_elevation(
+	solar_timeline_t *timeline, double date, double lat, double lon)
+{
+	if (!isfinite(date)) return solar_elevation(date, lat, lon);
+
+	if (!timeline->valid || timeline->lat != lat ||
+	    timeline->lon != lon || date < timeline->start ||
+	    date >= timeline->start + TIMELINE_LENGTH) {
+		solar_timeline_build(timeline, date - TIMELINE_MARGIN,
+				     lat, lon);
+	}
+
+	double offset = (date - timeline->start)/TIMELINE_SEGMENT_LENGTH;
+	int s = (int)offset;
+	if (s >= SOLAR_TIMELINE_SEGMENTS) s = SOLAR_TIMELINE_SEGMENTS-1;
+	double x = 2.0*(offset - s) - 1.0;
+
+	/* Clenshaw recurrence */
+	const double *c = timeline->coeffs[s];
+	double b1 = 0.0;
+	double b2 = 0.0;
+	for (int j = SOLAR_TIMELINE_DEGREE; j > 0; j--) {
+		double b = 2.0*x*b1 - b2 + c[j];
+		b2 = b1;
+		b1 = b;
+	}
+
+	return x*b1 - b2 + c[0];
+}
@@ -20,6 +20,8 @@
 #ifndef REDSHIFT_SOLAR_H
 #define REDSHIFT_SOLAR_H
 
+#include <stddef.h>
+
 #include "time.h"
 
 /* Model of atmospheric refraction near horizon (in degrees). */
@@ -45,7 +47,32 @@ typedef enum {
 } solar_time_t;
 
 
+/* Number of segments and polynomial degree of solar timeline. */
+#define SOLAR_TIMELINE_SEGMENTS  48
+#define SOLAR_TIMELINE_DEGREE    5
+
+/* Piecewise Chebyshev approximation of solar elevation over one day
+   at a fixed location. Compared with solar_elevation the error is
+   below 1.4e-6 degrees where the elevation is within 20 degrees of the
+   horizon, which covers the transition, and below 5e-6 degrees up to
+   70 degrees. Near the zenith and nadir the elevation is not smooth
+   and the error grows to about 0.62 degrees. See tests/test-solar.c. */
+typedef struct {
+	int valid;
+	double start;
+	double lat;
+	double lon;
+	double coeffs[SOLAR_TIMELINE_SEGMENTS][SOLAR_TIMELINE_DEGREE+1];
+} solar_timeline_t;
+
+
 double solar_elevation(double date, double lat, double lon);
+void solar_elevation_batch(
+	const double *dates, size_t n, double lat, double lon, double *out);
 void solar_table_fill(double date, double lat, double lon, double *table);
 
+void solar_timeline_init(solar_timeline_t *timeline);
+double solar_timeline_elevation(
+	solar_timeline_t *timeline, double date, double lat, double lon);
+
 #endif /* ! REDSHIFT_SOLAR_H */
@@ -34,10 +34,23 @@
 #include "systemtime.h"
 
 
+/* Virtual clock used instead of the system clock when simulating.
+   It only moves forward when waits are done, by the time waited. */
+static int virtual_enabled = 0;
+static double virtual_now = 0.0;
+/* Virtual seconds per real second, or zero to not wait at all. */
+static double virtual_speed = 0.0;
+
+
 /* Return current time in T as the number of seconds since the epoch. */
 int
 systemtime_get_time(double *t)
 {
+	if (virtual_enabled) {
+		*t = virtual_now;
+		return 0;
+	}
+
 #if defined(_WIN32) /* Windows */
 	FILETIME now;
 	ULARGE_INTEGER i;
@@ -70,6 +83,39 @@ systemtime_get_time(double *t)
 	return 0;
 }
 
+/* Return time in T as the number of seconds on a clock that is not
+   affected by changes of the system time. Only differences between
+   values are meaningful. */
+int
+systemtime_get_monotonic(double *t)
+{
+	if (virtual_enabled) {
+		*t = virtual_now;
+		return 0;
+	}
+
+#if defined(_WIN32) /* Windows */
+	LARGE_INTEGER now, frequency;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&frequency);
+
+	*t = now.QuadPart / (double)frequency.QuadPart;
+#elif _POSIX_TIMERS > 0 && defined(_POSIX_MONOTONIC_CLOCK)
+	struct timespec now;
+	int r = clock_gettime(CLOCK_MONOTONIC, &now);
+	if (r < 0) {
+		perror("clock_gettime");
+		return -1;
+	}
+
+	*t = now.tv_sec + (now.tv_nsec / 1000000000.0);
+#else /* other platforms */
+	return systemtime_get_time(t);
+#endif
+
+	return 0;
+}
+
 /* Sleep for a number of milliseconds. */
 void
 systemtime_msleep(unsigned int msecs)
@@ -83,3 +129,36 @@ systemtime_msleep(unsigned int msecs)
 	Sleep(msecs);
 #endif
 }
+
+/* Use virtual clock starting at START (seconds since the epoch) instead
+   of the system clock. Waits take 1/SPEED of the virtual time they
+   advance, or no time if SPEED is zero. */
+void
+systemtime_set_virtual(double start, double speed)
+{
+	virtual_enabled = 1;
+	virtual_now = start;
+	virtual_speed = speed;
+}
+
+int
+systemtime_is_virtual(void)
+{
+	return virtual_enabled;
+}
+
+/* Return real time (seconds) to wait for a timeout on the clock. */
+double
+systemtime_get_real_timeout(double timeout)
+{
+	if (!virtual_enabled || timeout < 0.0) return timeout;
+	if (virtual_speed <= 0.0) return 0.0;
+	return timeout / virtual_speed;
+}
+
+/* Move virtual clock forward after waiting. */
+void
+systemtime_advance(double seconds)
+{
+	if (virtual_enabled && seconds > 0.0) virtual_now += seconds;
+}
@@ -22,6 +22,12 @@
 
 
 int systemtime_get_time(double *now);
+int systemtime_get_monotonic(double *now);
 void systemtime_msleep(unsigned int msecs);
 
+void systemtime_set_virtual(double start, double speed);
+int systemtime_is_virtual(void);
+double systemtime_get_real_timeout(double timeout);
+void systemtime_advance(double seconds);
+
 #endif /* ! REDSHIFT_SYSTEMTIME_H */
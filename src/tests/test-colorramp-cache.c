@@ -0,0 +1,124 @@
+/* test-colorramp-cache.c -- Test of steady state allocations
+   This file is part of Redshift.
+
+   Redshift is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Redshift is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Redshift.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Runs the updates of a day through the ramp cache for two outputs
+   with different ramp sizes, as the gamma methods do, with fades
+   planned along the way. Once the first day has warmed up the cache
+   and the fade plan, the following days must not allocate. Built
+   with DEBUG_ALLOC. */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "redshift.h"
+#include "colorramp-cache.h"
+
+#define SMALL_SIZE   256
+#define LARGE_SIZE  4096
+
+#define FADE_FRAMES  40
+
+static uint16_t small_ramps[3*SMALL_SIZE];
+static uint16_t large_ramps[3*LARGE_SIZE];
+
+
+static void
+update(const color_setting_t *setting)
+{
+	colorramp_cache_fill(&small_ramps[0*SMALL_SIZE],
+			     &small_ramps[1*SMALL_SIZE],
+			     &small_ramps[2*SMALL_SIZE],
+			     SMALL_SIZE, setting, NULL);
+	colorramp_cache_fill(&large_ramps[0*LARGE_SIZE],
+			     &large_ramps[1*LARGE_SIZE],
+			     &large_ramps[2*LARGE_SIZE],
+			     LARGE_SIZE, setting, NULL);
+}
+
+static void
+set(color_setting_t *setting, int temperature, float brightness)
+{
+	setting->temperature = temperature;
+	setting->brightness = brightness;
+	setting->gamma[0] = setting->gamma[1] = setting->gamma[2] = 1.0;
+}
+
+/* Plan and show a fade from one setting to another. */
+static void
+fade(const color_setting_t *from, const color_setting_t *to)
+{
+	color_setting_t frames[FADE_FRAMES];
+	for (int i = 0; i < FADE_FRAMES; i++) {
+		double alpha = (i + 1) / (double)FADE_FRAMES;
+		set(&frames[i],
+		    from->temperature +
+		    alpha*(to->temperature - from->temperature),
+		    from->brightness +
+		    alpha*(to->brightness - from->brightness));
+	}
+
+	colorramp_cache_plan(frames, FADE_FRAMES);
+	for (int i = 0; i < FADE_FRAMES; i++) update(&frames[i]);
+	colorramp_cache_plan(NULL, 0);
+}
+
+/* Updates of one day: a toggle fade at day, the dusk transition in
+   1K steps with brightness following it, and a toggle fade at night.
+   The brightness of each day is different so that days only share
+   the fade settings. */
+static void
+run_day(int day)
+{
+	color_setting_t day_setting, night_setting, neutral, setting;
+	set(&day_setting, 6500, 1.0);
+	set(&night_setting, 3500, 0.8);
+	set(&neutral, NEUTRAL_TEMP, 1.0);
+
+	update(&day_setting);
+	fade(&day_setting, &neutral);
+	fade(&neutral, &day_setting);
+
+	for (int t = 6500; t >= 3500; t--) {
+		set(&setting, t, 0.8 + 0.2*(t - 3500)/3000.0 - 0.001*day);
+		update(&setting);
+	}
+
+	update(&night_setting);
+	fade(&night_setting, &neutral);
+	fade(&neutral, &night_setting);
+}
+
+int
+main(int argc, char *argv[])
+{
+	run_day(0);
+	unsigned long warm = colorramp_cache_get_alloc_count();
+	printf("Allocations on first day: %lu\n", warm);
+
+	for (int day = 1; day < 4; day++) run_day(day);
+	unsigned long steady = colorramp_cache_get_alloc_count() - warm;
+	printf("Allocations on following days: %lu\n", steady);
+
+	colorramp_cache_free();
+
+	if (warm == 0) {
+		fputs("No allocations were counted.\n", stderr);
+		return 1;
+	}
+
+	return steady == 0 ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+/* test-colorramp.c -- Test of vector kernels against double precision
+   This file is part of Redshift.
+
+   Redshift is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Redshift is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Redshift.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Fills ramps with each vector kernel supported by the processor and
+   with the double precision path, for temperatures from 1000K to
+   25000K, and checks that the integer ramps differ by at most one
+   in the last place. Built with DEBUG_SIMD. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#include "redshift.h"
+#include "colorramp.h"
+
+#define MAX_SIZE  4096
+
+static const int sizes[] = { 256, 1024, 4096 };
+static const float brightnesses[] = { 1.0, 0.7, 0.1 };
+static const float gammas[] = { 1.0, 0.6, 1.8 };
+
+#define N_ELEMENTS(a)  (sizeof(a)/sizeof((a)[0]))
+
+
+static void
+fill(uint16_t *ramps, int size, const color_setting_t *setting)
+{
+	for (int c = 0; c < 3; c++) {
+		for (int i = 0; i < size; i++) {
+			ramps[c*size + i] = (double)i/size * (UINT16_MAX+1);
+		}
+	}
+
+	colorramp_fill(&ramps[0*size], &ramps[1*size], &ramps[2*size],
+		       size, setting);
+}
+
+/* Return largest difference between kernel at level and the double
+   precision path for size and a temperature sweep. */
+static int
+check_sweep(int level, int size, float brightness, float gamma)
+{
+	static uint16_t expected[3*MAX_SIZE];
+	static uint16_t actual[3*MAX_SIZE];
+
+	int max_diff = 0;
+	for (int temp = 1000; temp <= 25000; temp += 100) {
+		color_setting_t setting = {
+			.temperature = temp,
+			.gamma = { gamma, 1.0, gamma },
+			.brightness = brightness
+		};
+
+		colorramp_set_simd_level(0);
+		fill(expected, size, &setting);
+		colorramp_set_simd_level(level);
+		fill(actual, size, &setting);
+
+		for (int i = 0; i < 3*size; i++) {
+			int diff = abs((int)actual[i] - (int)expected[i]);
+			if (diff > max_diff) max_diff = diff;
+		}
+	}
+
+	return max_diff;
+}
+
+/* Return largest difference between kernel at level and the double
+   precision path over all settings. */
+static int
+check_level(int level)
+{
+	int max_diff = 0;
+	for (int i = 0; i < N_ELEMENTS(sizes); i++) {
+		for (int j = 0; j < N_ELEMENTS(brightnesses); j++) {
+			for (int k = 0; k < N_ELEMENTS(gammas); k++) {
+				int diff = check_sweep(
+					level, sizes[i], brightnesses[j],
+					gammas[k]);
+				if (diff > max_diff) max_diff = diff;
+			}
+		}
+	}
+
+	return max_diff;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int failed = 0;
+	int max_level = colorramp_set_simd_level(INT_MAX);
+	for (int level = 1; level <= max_level; level++) {
+		int max_diff = check_level(level);
+		printf("Level %d: largest difference %d\n", level, max_diff);
+		if (max_diff > 1) failed = 1;
+	}
+
+	if (max_level == 0) puts("No vector kernels on this processor.");
+
+	return failed;
+}
@@ -0,0 +1,270 @@
+/* test-drm-uevent.c -- Test of device event parsing
+   This file is part of Redshift.
+
+   Redshift is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Redshift is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Redshift.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Feeds device events as sent by the kernel and as forwarded by udev
+   through the parser of the DRM method and checks the result. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "drm-uevent.h"
+
+/* Size of the header that libudev puts before the properties */
+#define UDEV_HEADER_SIZE  40
+
+#define UDEV_MAGIC  0xfeedcafe
+
+typedef struct {
+	const char *name;
+	/* Properties, each terminated by a null character. Kernel
+	   messages start with ACTION@DEVPATH. */
+	const char *data;
+	size_t len;
+	int expected;
+	const char *action;
+	int card_num;
+	int hotplug;
+} test_case_t;
+
+#define MESSAGE(s)  s, sizeof(s) - 1
+
+static const test_case_t kernel_cases[] = {
+	{ "kernel add", MESSAGE(
+		"add@/devices/pci0000:00/0000:00:02.0/drm/card0\0"
+		"ACTION=add\0"
+		"DEVPATH=/devices/pci0000:00/0000:00:02.0/drm/card0\0"
+		"SUBSYSTEM=drm\0"
+		"DEVNAME=dri/card0\0"
+		"DEVTYPE=drm_minor\0"
+		"SEQNUM=4711\0"
+		"MAJOR=226\0"
+		"MINOR=0\0"),
+	  1, "add", 0, 0 },
+	{ "kernel remove", MESSAGE(
+		"remove@/devices/pci0000:00/0000:00:02.0/drm/card1\0"
+		"ACTION=remove\0"
+		"DEVPATH=/devices/pci0000:00/0000:00:02.0/drm/card1\0"
+		"SUBSYSTEM=drm\0"
+		"DEVNAME=dri/card1\0"
+		"DEVTYPE=drm_minor\0"
+		"SEQNUM=4712\0"
+		"MAJOR=226\0"
+		"MINOR=1\0"),
+	  1, "remove", 1, 0 },
+	{ "kernel change with hotplug", MESSAGE(
+		"change@/devices/pci0000:00/0000:00:02.0/drm/card0\0"
+		"ACTION=change\0"
+		"DEVPATH=/devices/pci0000:00/0000:00:02.0/drm/card0\0"
+		"SUBSYSTEM=drm\0"
+		"HOTPLUG=1\0"
+		"DEVNAME=dri/card0\0"
+		"DEVTYPE=drm_minor\0"
+		"SEQNUM=4713\0"
+		"MAJOR=226\0"
+		"MINOR=0\0"),
+	  1, "change", 0, 1 },
+	{ "kernel change without hotplug", MESSAGE(
+		"change@/devices/pci0000:00/0000:00:02.0/drm/card0\0"
+		"ACTION=change\0"
+		"DEVPATH=/devices/pci0000:00/0000:00:02.0/drm/card0\0"
+		"SUBSYSTEM=drm\0"
+		"DEVNAME=dri/card0\0"
+		"DEVTYPE=drm_minor\0"
+		"SEQNUM=4714\0"
+		"MAJOR=226\0"
+		"MINOR=0\0"),
+	  1, "change", 0, 0 },
+	{ "kernel render node", MESSAGE(
+		"add@/devices/pci0000:00/0000:00:02.0/drm/renderD128\0"
+		"ACTION=add\0"
+		"DEVPATH=/devices/pci0000:00/0000:00:02.0/drm/renderD128\0"
+		"SUBSYSTEM=drm\0"
+		"DEVNAME=dri/renderD128\0"
+		"DEVTYPE=drm_minor\0"
+		"SEQNUM=4715\0"
+		"MAJOR=226\0"
+		"MINOR=128\0"),
+	  0, "add", -1, 0 },
+	{ "kernel connector", MESSAGE(
+		"add@/devices/pci0000:00/0000:00:02.0/drm/card0/card0-HDMI-A-1\0"
+		"ACTION=add\0"
+		"DEVPATH=/devices/pci0000:00/0000:00:02.0/drm/card0/"
+		"card0-HDMI-A-1\0"
+		"SUBSYSTEM=drm\0"
+		"SEQNUM=4716\0"),
+	  0, "add", -1, 0 },
+	{ "kernel other subsystem", MESSAGE(
+		"add@/devices/virtual/input/input7\0"
+		"ACTION=add\0"
+		"DEVPATH=/devices/virtual/input/input7\0"
+		"SUBSYSTEM=input\0"
+		"DEVNAME=input/card0\0"
+		"SEQNUM=4717\0"),
+	  0, "add", 0, 0 },
+	{ "kernel truncated property", MESSAGE(
+		"change@/devices/pci0000:00/0000:00:02.0/drm/card0\0"
+		"ACTION=change\0"
+		"SUBSYSTEM=drm\0"
+		"DEVNAME=dri/ca"),
+	  -1, "change", -1, 0 },
+	{ "kernel missing header", MESSAGE(
+		"ACTION=change\0"
+		"SUBSYSTEM=drm\0"
+		"DEVNAME=dri/card0\0"),
+	  -1, "", -1, 0 }
+};
+
+static const test_case_t udev_cases[] = {
+	{ "udev add", MESSAGE(
+		"ACTION=add\0"
+		"DEVPATH=/devices/pci0000:00/0000:01:00.0/drm/card1\0"
+		"SUBSYSTEM=drm\0"
+		"DEVNAME=/dev/dri/card1\0"
+		"DEVTYPE=drm_minor\0"
+		"SEQNUM=5120\0"
+		"USEC_INITIALIZED=8123456\0"
+		"MAJOR=226\0"
+		"MINOR=1\0"
+		"TAGS=:seat:uaccess:\0"),
+	  1, "add", 1, 0 },
+	{ "udev remove", MESSAGE(
+		"ACTION=remove\0"
+		"DEVPATH=/devices/pci0000:00/0000:01:00.0/drm/card1\0"
+		"SUBSYSTEM=drm\0"
+		"DEVNAME=/dev/dri/card1\0"
+		"DEVTYPE=drm_minor\0"
+		"SEQNUM=5121\0"
+		"MAJOR=226\0"
+		"MINOR=1\0"),
+	  1, "remove", 1, 0 },
+	{ "udev change with hotplug", MESSAGE(
+		"ACTION=change\0"
+		"DEVPATH=/devices/pci0000:00/0000:00:02.0/drm/card12\0"
+		"SUBSYSTEM=drm\0"
+		"HOTPLUG=1\0"
+		"CONNECTOR=95\0"
+		"DEVNAME=/dev/dri/card12\0"
+		"DEVTYPE=drm_minor\0"
+		"SEQNUM=5122\0"
+		"MAJOR=226\0"
+		"MINOR=12\0"),
+	  1, "change", 12, 1 },
+	{ "udev change without hotplug", MESSAGE(
+		"ACTION=change\0"
+		"DEVPATH=/devices/pci0000:00/0000:00:02.0/drm/card0\0"
+		"SUBSYSTEM=drm\0"
+		"DEVNAME=/dev/dri/card0\0"
+		"DEVTYPE=drm_minor\0"
+		"SEQNUM=5123\0"
+		"MAJOR=226\0"
+		"MINOR=0\0"),
+	  1, "change", 0, 0 },
+	{ "udev render node", MESSAGE(
+		"ACTION=change\0"
+		"DEVPATH=/devices/pci0000:00/0000:00:02.0/drm/renderD128\0"
+		"SUBSYSTEM=drm\0"
+		"DEVNAME=/dev/dri/renderD128\0"
+		"DEVTYPE=drm_minor\0"
+		"SEQNUM=5124\0"
+		"MAJOR=226\0"
+		"MINOR=128\0"),
+	  0, "change", -1, 0 }
+};
+
+#define N_ELEMENTS(a)  (sizeof(a)/sizeof((a)[0]))
+
+
+/* Put properties after a libudev header in buffer and return length
+   of the message. */
+static size_t
+udev_frame(char *buffer, const char *properties, size_t len)
+{
+	uint32_t fields[] = {
+		htonl(UDEV_MAGIC),
+		UDEV_HEADER_SIZE,
+		UDEV_HEADER_SIZE,
+		len,
+		/* Filter hashes and tag bloom filter */
+		0, 0, 0, 0
+	};
+
+	memcpy(buffer, "libudev", 8);
+	memcpy(buffer + 8, fields, sizeof(fields));
+	memcpy(buffer + UDEV_HEADER_SIZE, properties, len);
+
+	return UDEV_HEADER_SIZE + len;
+}
+
+/* Return 1 if event parsed from message matches test case. */
+static int
+check(const test_case_t *test, const char *buf, size_t len)
+{
+	drm_uevent_t event;
+	int r = drm_parse_uevent(buf, len, &event);
+
+	int ok = r == test->expected;
+	if (r > 0) {
+		ok = ok && strcmp(event.action, test->action) == 0 &&
+			event.card_num == test->card_num &&
+			event.hotplug == test->hotplug;
+	}
+
+	printf("%s: %s (%d, action `%s', card %d, hotplug %d)\n",
+	       ok ? "PASS" : "FAIL", test->name, r, event.action,
+	       event.card_num, event.hotplug);
+
+	return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+	static char buffer[4096];
+	int failed = 0;
+
+	for (int i = 0; i < N_ELEMENTS(kernel_cases); i++) {
+		const test_case_t *test = &kernel_cases[i];
+		if (!check(test, test->data, test->len)) failed = 1;
+	}
+
+	for (int i = 0; i < N_ELEMENTS(udev_cases); i++) {
+		const test_case_t *test = &udev_cases[i];
+		size_t len = udev_frame(buffer, test->data, test->len);
+		if (!check(test, buffer, len)) failed = 1;
+	}
+
+	/* Header of udev cut short, and properties beyond the end of
+	   the message. */
+	const test_case_t *test = &udev_cases[2];
+	size_t len = udev_frame(buffer, test->data, test->len);
+	const test_case_t truncated[] = {
+		{ .name = "udev truncated header", .data = buffer,
+		  .len = 20, .expected = -1 },
+		{ .name = "udev truncated properties", .data = buffer,
+		  .len = len - 10, .expected = -1 }
+	};
+	for (int i = 0; i < N_ELEMENTS(truncated); i++) {
+		if (!check(&truncated[i], truncated[i].data,
+			   truncated[i].len)) {
+			failed = 1;
+		}
+	}
+
+	return failed;
+}
@@ -0,0 +1,103 @@
+#!/bin/sh
+# test-fade-timing.sh -- Test of fade timing on the virtual clock
+# This file is part of Redshift.
+#
+# Redshift is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Redshift is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Redshift.  If not, see <http://www.gnu.org/licenses/>.
+
+# Runs the initial fade to a fixed temperature with the dummy method in
+# simulation mode, which is deterministic, and checks that all frames
+# of the fade are shown within its duration and that the last one is
+# at the target. Then runs a fade on the real clock with adjustments
+# that take longer than a frame, and checks that frames are dropped
+# rather than delaying the end of the fade.
+
+REDSHIFT=${REDSHIFT:-./redshift}
+
+# Daytime at the location below
+START=1790000000
+TARGET=5000
+
+config=$(mktemp) || exit 1
+output_file=$(mktemp) || exit 1
+trap 'rm -f "$config" "$output_file"' EXIT
+
+# Usage: check_fade DURATION FPS
+check_fade() {
+	printf '[redshift]\nfade-duration=%s\nfade-fps=%s\n' "$1" "$2" \
+		> "$config"
+
+	end=$(awk "BEGIN { print $START + $1 }")
+	output=$("$REDSHIFT" -c "$config" -m dummy -l 55:12 \
+		-t $TARGET:3000 -S $START:$end:0 2> /dev/null) || {
+		echo "Fade of $1 s at $2 fps: redshift failed"
+		return 1
+	}
+
+	# Every frame is set on the dummy method. The simulation prints
+	# the time of each frame that changes the setting.
+	echo "$output" | awk -v start=$START -v duration="$1" -v fps="$2" \
+		-v target=$TARGET '
+		/^Temperature: / { frames++ }
+		/^[0-9.]+ [0-9]+ [0-9.]+$/ {
+			if (first == "") first = $1
+			last = $1
+			temp = $2
+		}
+		END {
+			expected = int(duration*fps + 0.5)
+			last_due = start + (expected - 1)/fps
+			printf("Fade of %s s at %s fps: %d frames, last change" \
+			       " %.2f s after start at %dK\n", duration, fps,
+			       frames, last - start, temp)
+			if (frames != expected || first != start ||
+			    last > last_due + 0.005 || temp != target) exit 1
+		}'
+}
+
+# Usage: check_slow_fade DURATION FPS DELAY
+check_slow_fade() {
+	printf '[redshift]\nfade-duration=%s\nfade-fps=%s\n' "$1" "$2" \
+		> "$config"
+
+	"$REDSHIFT" -c "$config" -m dummy:delay=$3 -l 55:12 \
+		-t $TARGET:$TARGET > "$output_file" 2> /dev/null &
+	pid=$!
+
+	# The fade must be done within the duration and the time of one
+	# late adjustment, plus some time to start.
+	wait_time=$(awk "BEGIN { print $1 + $3/1000 + 0.3 }")
+	sleep $wait_time
+	output=$(cat "$output_file")
+	kill $pid
+	wait $pid
+
+	echo "$output" | awk -v duration="$1" -v fps="$2" -v delay="$3" \
+		-v target=$TARGET -v wait_time=$wait_time '
+		/^Temperature: / { frames++; temp = $2 }
+		END {
+			printf("Fade of %s s at %s fps with %s ms per" \
+			       " adjustment: %d frames, at %dK after %s s\n",
+			       duration, fps, delay, frames, temp, wait_time)
+			if (frames < 2 || frames >= duration*fps ||
+			    temp != target) exit 1
+		}'
+}
+
+failed=0
+check_fade 4 10 || failed=1
+check_fade 2 60 || failed=1
+check_fade 1 1 || failed=1
+check_slow_fade 1 20 120 || failed=1
+
+exit $failed
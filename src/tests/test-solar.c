@@ -0,0 +1,84 @@
+/* test-solar.c -- Test of solar timeline accuracy
+   This file is part of Redshift.
+
+   Redshift is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Redshift is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Redshift.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Compares the solar timeline with solar_elevation over a year at
+   locations from pole to pole. The error must stay within the bounds
+   documented in solar.h. */
+
+#include <stdio.h>
+#include <math.h>
+
+#include "solar.h"
+
+/* 2027-01-01 00:00 UTC */
+#define YEAR_START  1798761600.0
+
+/* Bounds on the error for each range of elevations. */
+static const struct {
+	double elevation;
+	double max_error;
+} bounds[] = {
+	{ 20.0, 2e-6 },
+	{ 70.0, 1e-5 },
+	{ 90.0, 0.7 }
+};
+
+#define N_BOUNDS  (sizeof(bounds)/sizeof(bounds[0]))
+
+
+int
+main(int argc, char *argv[])
+{
+	double max_error[N_BOUNDS] = { 0.0 };
+
+	for (double lat = -89.0; lat <= 89.0; lat += 8.9) {
+		for (double lon = -180.0; lon < 180.0; lon += 45.0) {
+			solar_timeline_t timeline;
+			solar_timeline_init(&timeline);
+
+			for (int day = 0; day < 365; day += 7) {
+				double start = YEAR_START + day*86400.0;
+				for (double t = 0; t < 86400.0; t += 97.0) {
+					double date = start + t;
+					double expected = solar_elevation(
+						date, lat, lon);
+					double actual =
+						solar_timeline_elevation(
+							&timeline, date,
+							lat, lon);
+					double error = fabs(actual - expected);
+
+					int i = 0;
+					while (i < N_BOUNDS-1 &&
+					       fabs(expected) >=
+					       bounds[i].elevation) i++;
+					max_error[i] = fmax(
+						max_error[i], error);
+				}
+			}
+		}
+	}
+
+	int failed = 0;
+	for (int i = 0; i < N_BOUNDS; i++) {
+		printf("Largest error below %.0f degrees: %g\n",
+		       bounds[i].elevation, max_error[i]);
+		if (max_error[i] > bounds[i].max_error) failed = 1;
+	}
+
+	return failed;
+}